@@ -12,6 +12,9 @@
 #include <stdio.h>
 #include <math.h>
 #include "vec.h"
+#if defined(__BMI2__) || defined(__SSE2__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
 
 #define PI 3.1415926535
 
@@ -33,6 +36,8 @@ float flim(float x, float lim) {
 }
 
 float fminf(float, float);
+float fmaxf(float, float);
+float sqrtf(float);
 
 /*---- vector functions ----*/
 
@@ -1565,6 +1570,146 @@ m4 m4xm4(m4 m1, m4 m2) {
   return m;
 }
 
+/* batched matrix multiplication */
+
+#ifdef __SSE2__
+/**
+ * m4 row combination kernel.
+ * one output row, the rows b0 to b3 of the right matrix
+ * weighted by the broadcast row w0 to w3 of the left one.
+ */
+static __m128 m4comb(__m128 w0, __m128 w1, __m128 w2, __m128 w3,
+                     __m128 b0, __m128 b1, __m128 b2, __m128 b3) {
+  return _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, b0), _mm_mul_ps(w1, b1)),
+                    _mm_add_ps(_mm_mul_ps(w2, b2), _mm_mul_ps(w3, b3)));
+}
+#else
+/**
+ * m4 multiplication kernel.
+ * row combination form, output row i is the sum of the
+ * rows of b weighted by a[i][0..3]. out may alias a or b.
+ *
+ * @param a left m4
+ * @param b right m4
+ * @param out m4 receiving a * b
+ */
+static void m4xm4to(const m4 *a, const m4 *b, m4 *out) {
+  int i, j, k;
+  float r[4][4];
+  for (i = 0; i < 4; i++) {
+    for (j = 0; j < 4; j++)
+      r[i][j] = a->m[i][0] * b->m[0][j];
+    for (k = 1; k < 4; k++)
+      for (j = 0; j < 4; j++)
+        r[i][j] += a->m[i][k] * b->m[k][j];
+  }
+  for (i = 0; i < 4; i++)
+    for (j = 0; j < 4; j++)
+      out->m[i][j] = r[i][j];
+}
+#endif
+
+/**
+ * m4 by m4 array multiplication.
+ * left multiply every matrix in b by a.
+ * with sse2 the 16 entries of a are broadcast once
+ * before the loop and each b[i] costs four row loads.
+ *
+ * @param a shared left m4
+ * @param b array of n m4
+ * @param out array of n m4 receiving a * b[i], may be b
+ * @param n number of matrices
+ * @return void
+ */
+void m4xm4n(m4 a, const m4 *b, m4 *out, int n) {
+  int i;
+#ifdef __SSE2__
+  __m128 w[16], b0, b1, b2, b3, r0, r1, r2, r3;
+  for (i = 0; i < 16; i++)
+    w[i] = _mm_set1_ps(a.m[i >> 2][i & 3]);
+  for (i = 0; i < n; i++) {
+    b0 = _mm_loadu_ps(b[i].m[0]);
+    b1 = _mm_loadu_ps(b[i].m[1]);
+    b2 = _mm_loadu_ps(b[i].m[2]);
+    b3 = _mm_loadu_ps(b[i].m[3]);
+    r0 = m4comb(w[0], w[1], w[2], w[3], b0, b1, b2, b3);
+    r1 = m4comb(w[4], w[5], w[6], w[7], b0, b1, b2, b3);
+    r2 = m4comb(w[8], w[9], w[10], w[11], b0, b1, b2, b3);
+    r3 = m4comb(w[12], w[13], w[14], w[15], b0, b1, b2, b3);
+    _mm_storeu_ps(out[i].m[0], r0);
+    _mm_storeu_ps(out[i].m[1], r1);
+    _mm_storeu_ps(out[i].m[2], r2);
+    _mm_storeu_ps(out[i].m[3], r3);
+  }
+#else
+  for (i = 0; i < n; i++)
+    m4xm4to(&a, &b[i], &out[i]);
+#endif
+}
+
+#ifdef __SSE2__
+/** a m4 times the rows b0 to b3, every row is read before out is written */
+static void m4rows(const m4 *a, __m128 b0, __m128 b1, __m128 b2, __m128 b3,
+                   m4 *out) {
+  __m128 r[4];
+  int i;
+  for (i = 0; i < 4; i++)
+    r[i] = m4comb(_mm_set1_ps(a->m[i][0]), _mm_set1_ps(a->m[i][1]),
+                  _mm_set1_ps(a->m[i][2]), _mm_set1_ps(a->m[i][3]),
+                  b0, b1, b2, b3);
+  for (i = 0; i < 4; i++)
+    _mm_storeu_ps(out->m[i], r[i]);
+}
+#endif
+
+/**
+ * m4 array by m4 multiplication.
+ * right multiply every matrix in a by b,
+ * eg. per instance model matrices by a shared view.
+ * with sse2 the rows of b stay in registers for the
+ * whole array.
+ *
+ * @param a array of n m4
+ * @param b shared right m4
+ * @param out array of n m4 receiving a[i] * b, may be a
+ * @param n number of matrices
+ * @return void
+ */
+void m4nxm4(const m4 *a, m4 b, m4 *out, int n) {
+  int i;
+#ifdef __SSE2__
+  __m128 b0 = _mm_loadu_ps(b.m[0]), b1 = _mm_loadu_ps(b.m[1]);
+  __m128 b2 = _mm_loadu_ps(b.m[2]), b3 = _mm_loadu_ps(b.m[3]);
+  for (i = 0; i < n; i++)
+    m4rows(&a[i], b0, b1, b2, b3, &out[i]);
+#else
+  for (i = 0; i < n; i++)
+    m4xm4to(&a[i], &b, &out[i]);
+#endif
+}
+
+/**
+ * m4 array by m4 array multiplication.
+ * pairwise product of two matrix arrays.
+ *
+ * @param a array of n m4
+ * @param b array of n m4
+ * @param out array of n m4 receiving a[i] * b[i], may be a or b
+ * @param n number of matrices
+ * @return void
+ */
+void m4nxm4n(const m4 *a, const m4 *b, m4 *out, int n) {
+  int i;
+#ifdef __SSE2__
+  for (i = 0; i < n; i++)
+    m4rows(&a[i], _mm_loadu_ps(b[i].m[0]), _mm_loadu_ps(b[i].m[1]),
+           _mm_loadu_ps(b[i].m[2]), _mm_loadu_ps(b[i].m[3]), &out[i]);
+#else
+  for (i = 0; i < n; i++)
+    m4xm4to(&a[i], &b[i], &out[i]);
+#endif
+}
+
 /**
  * matrix vector multiplication.
  * transform v by matrix m through right multiplication.
@@ -1647,6 +1792,7055 @@ m4 m4lookat(v4 pos, v4 target, v4 up) {
   }};
 }
 
+/*---- affine matrix functions ----*/
+
+/**
+ * affine identity matrix.
+ *
+ * @return an a3 that leaves points unchanged
+ */
+a3 a3id() {
+  return (a3){{
+    {1, 0, 0},
+    {0, 1, 0},
+    {0, 0, 1},
+    {0, 0, 0}
+  }};
+}
+
+/**
+ * m4 to affine matrix.
+ * drops the projective column of m,
+ * which is assumed to be (0, 0, 0, 1).
+ *
+ * @param m an affine m4
+ * @return a3 with the same transform
+ */
+a3 m4toa3(m4 m) {
+  int i;
+  a3 a;
+  for (i = 0; i < 4; i++) {
+    a.m[i][0] = m.m[i][0];
+    a.m[i][1] = m.m[i][1];
+    a.m[i][2] = m.m[i][2];
+  }
+  return a;
+}
+
+/**
+ * affine matrix to m4.
+ * restores the constant projective column.
+ *
+ * @param a a3
+ * @return m4 with the same transform
+ */
+m4 a3tom4(a3 a) {
+  int i;
+  m4 m;
+  for (i = 0; i < 4; i++) {
+    m.m[i][0] = a.m[i][0];
+    m.m[i][1] = a.m[i][1];
+    m.m[i][2] = a.m[i][2];
+    m.m[i][3] = 0;
+  }
+  m.m[3][3] = 1;
+  return m;
+}
+
+/**
+ * affine matrix multiplication.
+ * same as m4xm4 on the expanded matrices,
+ * but skips every product against the constant column.
+ *
+ * @param a a3
+ * @param b a3
+ * @return a3 applying a then b
+ */
+a3 a3xa3(a3 a, a3 b) {
+  int i, j;
+  a3 r;
+  for (i = 0; i < 4; i++)
+    for (j = 0; j < 3; j++)
+      r.m[i][j] = a.m[i][0] * b.m[0][j] +
+                  a.m[i][1] * b.m[1][j] +
+                  a.m[i][2] * b.m[2][j];
+  for (j = 0; j < 3; j++)
+    r.m[3][j] += b.m[3][j];
+  return r;
+}
+
+/**
+ * invert an affine matrix.
+ * inverts the 3x3 linear part by its adjugate and
+ * maps the translation back through it, so unlike m4invert
+ * this holds for scale and shear as well as rotation.
+ *
+ * @param a an invertible a3
+ * @return a3 undoing a
+ */
+a3 a3invert(a3 a) {
+  a3 r;
+  float det;
+  int j;
+  r.m[0][0] = a.m[1][1] * a.m[2][2] - a.m[1][2] * a.m[2][1];
+  r.m[0][1] = a.m[0][2] * a.m[2][1] - a.m[0][1] * a.m[2][2];
+  r.m[0][2] = a.m[0][1] * a.m[1][2] - a.m[0][2] * a.m[1][1];
+  r.m[1][0] = a.m[1][2] * a.m[2][0] - a.m[1][0] * a.m[2][2];
+  r.m[1][1] = a.m[0][0] * a.m[2][2] - a.m[0][2] * a.m[2][0];
+  r.m[1][2] = a.m[0][2] * a.m[1][0] - a.m[0][0] * a.m[1][2];
+  r.m[2][0] = a.m[1][0] * a.m[2][1] - a.m[1][1] * a.m[2][0];
+  r.m[2][1] = a.m[0][1] * a.m[2][0] - a.m[0][0] * a.m[2][1];
+  r.m[2][2] = a.m[0][0] * a.m[1][1] - a.m[0][1] * a.m[1][0];
+  det = 1.0f / (
+    a.m[0][0] * r.m[0][0] +
+    a.m[0][1] * r.m[1][0] +
+    a.m[0][2] * r.m[2][0]
+  );
+  for (j = 0; j < 3; j++) {
+    r.m[0][j] *= det;
+    r.m[1][j] *= det;
+    r.m[2][j] *= det;
+  }
+  for (j = 0; j < 3; j++)
+    r.m[3][j] = -(
+      a.m[3][0] * r.m[0][j] +
+      a.m[3][1] * r.m[1][j] +
+      a.m[3][2] * r.m[2][j]
+    );
+  return r;
+}
+
+/**
+ * affine matrix vector 3 multiplication.
+ * transform v as a point, translation applied.
+ *
+ * @param a a3
+ * @param v v3
+ * @return v3 transformed point
+ */
+v3 a3xv3(a3 a, v3 v) {
+  return (v3){
+    v.x * a.m[0][0] + v.y * a.m[1][0] + v.z * a.m[2][0] + a.m[3][0],
+    v.x * a.m[0][1] + v.y * a.m[1][1] + v.z * a.m[2][1] + a.m[3][1],
+    v.x * a.m[0][2] + v.y * a.m[1][2] + v.z * a.m[2][2] + a.m[3][2]
+  };
+}
+
+/**
+ * affine matrix vector 2 multiplication.
+ * v promoted to a point with z = 0.
+ *
+ * @param a a3
+ * @param v v2
+ * @return v3 transformed point
+ */
+v3 a3xv2(a3 a, v2 v) {
+  v3 promoted = {v.x, v.y, 0};
+  return a3xv3(a, promoted);
+}
+
+/**
+ * affine matrix vector 4 multiplication.
+ * translation is scaled by v.w, so w = 1 is a point
+ * and w = 0 a direction. w passes through unchanged.
+ *
+ * @param a a3
+ * @param v v4
+ * @return v4 transformed vector
+ */
+v4 a3xv4(a3 a, v4 v) {
+  return (v4){
+    v.x * a.m[0][0] + v.y * a.m[1][0] + v.z * a.m[2][0] + v.w * a.m[3][0],
+    v.x * a.m[0][1] + v.y * a.m[1][1] + v.z * a.m[2][1] + v.w * a.m[3][1],
+    v.x * a.m[0][2] + v.y * a.m[1][2] + v.z * a.m[2][2] + v.w * a.m[3][2],
+    v.w
+  };
+}
+
+/**
+ * affine matrix direction multiplication.
+ * transform v as a direction, translation ignored.
+ *
+ * @param a a3
+ * @param v v3
+ * @return v3 transformed direction
+ */
+v3 a3dir(a3 a, v3 v) {
+  return (v3){
+    v.x * a.m[0][0] + v.y * a.m[1][0] + v.z * a.m[2][0],
+    v.x * a.m[0][1] + v.y * a.m[1][1] + v.z * a.m[2][1],
+    v.x * a.m[0][2] + v.y * a.m[1][2] + v.z * a.m[2][2]
+  };
+}
+
+/* batched affine functions */
+
+/**
+ * affine matrix array multiplication.
+ * pairwise composition, eg. local by parent transforms
+ * when walking a hierarchy.
+ *
+ * @param a array of n a3
+ * @param b array of n a3
+ * @param out array of n a3 receiving a[i] then b[i], may be a or b
+ * @param n number of matrices
+ * @return void
+ */
+void a3nxa3n(const a3 *a, const a3 *b, a3 *out, int n) {
+  int i;
+  for (i = 0; i < n; i++)
+    out[i] = a3xa3(a[i], b[i]);
+}
+
+/**
+ * affine matrix v3 array multiplication.
+ * transform n points by a.
+ *
+ * @param a shared a3
+ * @param v array of n v3
+ * @param out array of n v3, may be v
+ * @param n number of points
+ * @return void
+ */
+void a3xv3n(a3 a, const v3 *v, v3 *out, int n) {
+  int i;
+  float x, y, z;
+  for (i = 0; i < n; i++) {
+    x = v[i].x;
+    y = v[i].y;
+    z = v[i].z;
+    out[i].x = x * a.m[0][0] + y * a.m[1][0] + z * a.m[2][0] + a.m[3][0];
+    out[i].y = x * a.m[0][1] + y * a.m[1][1] + z * a.m[2][1] + a.m[3][1];
+    out[i].z = x * a.m[0][2] + y * a.m[1][2] + z * a.m[2][2] + a.m[3][2];
+  }
+}
+
+/**
+ * affine matrix direction array multiplication.
+ * transform n directions by a, translation ignored.
+ *
+ * @param a shared a3
+ * @param v array of n v3
+ * @param out array of n v3, may be v
+ * @param n number of directions
+ * @return void
+ */
+void a3dirn(a3 a, const v3 *v, v3 *out, int n) {
+  int i;
+  float x, y, z;
+  for (i = 0; i < n; i++) {
+    x = v[i].x;
+    y = v[i].y;
+    z = v[i].z;
+    out[i].x = x * a.m[0][0] + y * a.m[1][0] + z * a.m[2][0];
+    out[i].y = x * a.m[0][1] + y * a.m[1][1] + z * a.m[2][1];
+    out[i].z = x * a.m[0][2] + y * a.m[1][2] + z * a.m[2][2];
+  }
+}
+
+/*---- 2d affine matrix functions ----*/
+
+/**
+ * 2d affine identity matrix.
+ *
+ * @return an a2 that leaves points unchanged
+ */
+a2 a2id() {
+  return (a2){{
+    {1, 0},
+    {0, 1},
+    {0, 0}
+  }};
+}
+
+/**
+ * 2d translation matrix.
+ *
+ * @param x translation in x dimension
+ * @param y translation in y dimension
+ * @return an a2 translation
+ */
+a2 a2trans(float x, float y) {
+  return (a2){{
+    {1, 0},
+    {0, 1},
+    {x, y}
+  }};
+}
+
+/**
+ * 2d rotation matrix.
+ * same sense as m4zrot.
+ *
+ * @param r rotation in radians
+ * @return an a2 rotation
+ */
+a2 a2rot(float r) {
+  float c = cos(r);
+  float s = sin(r);
+  return (a2){{
+    { c, s},
+    {-s, c},
+    { 0, 0}
+  }};
+}
+
+/**
+ * 2d scale matrix.
+ *
+ * @param x scale in x dimension
+ * @param y scale in y dimension
+ * @return an a2 scale
+ */
+a2 a2scl(float x, float y) {
+  return (a2){{
+    {x, 0},
+    {0, y},
+    {0, 0}
+  }};
+}
+
+/**
+ * 2d affine matrix multiplication.
+ *
+ * @param a a2
+ * @param b a2
+ * @return a2 applying a then b
+ */
+a2 a2xa2(a2 a, a2 b) {
+  return (a2){{
+    {
+      a.m[0][0] * b.m[0][0] + a.m[0][1] * b.m[1][0],
+      a.m[0][0] * b.m[0][1] + a.m[0][1] * b.m[1][1]
+    },
+    {
+      a.m[1][0] * b.m[0][0] + a.m[1][1] * b.m[1][0],
+      a.m[1][0] * b.m[0][1] + a.m[1][1] * b.m[1][1]
+    },
+    {
+      a.m[2][0] * b.m[0][0] + a.m[2][1] * b.m[1][0] + b.m[2][0],
+      a.m[2][0] * b.m[0][1] + a.m[2][1] * b.m[1][1] + b.m[2][1]
+    }
+  }};
+}
+
+/**
+ * invert a 2d affine matrix.
+ *
+ * @param a an invertible a2
+ * @return a2 undoing a
+ */
+a2 a2invert(a2 a) {
+  float det = 1.0f / (a.m[0][0] * a.m[1][1] - a.m[0][1] * a.m[1][0]);
+  a2 r;
+  r.m[0][0] =  a.m[1][1] * det;
+  r.m[0][1] = -a.m[0][1] * det;
+  r.m[1][0] = -a.m[1][0] * det;
+  r.m[1][1] =  a.m[0][0] * det;
+  r.m[2][0] = -(a.m[2][0] * r.m[0][0] + a.m[2][1] * r.m[1][0]);
+  r.m[2][1] = -(a.m[2][0] * r.m[0][1] + a.m[2][1] * r.m[1][1]);
+  return r;
+}
+
+/**
+ * 2d affine matrix vector 2 multiplication.
+ * transform v as a point, translation applied.
+ *
+ * @param a a2
+ * @param v v2
+ * @return v2 transformed point
+ */
+v2 a2xv2(a2 a, v2 v) {
+  return (v2){
+    v.x * a.m[0][0] + v.y * a.m[1][0] + a.m[2][0],
+    v.x * a.m[0][1] + v.y * a.m[1][1] + a.m[2][1]
+  };
+}
+
+/**
+ * 2d affine matrix direction multiplication.
+ * transform v as a direction, translation ignored.
+ *
+ * @param a a2
+ * @param v v2
+ * @return v2 transformed direction
+ */
+v2 a2dir(a2 a, v2 v) {
+  return (v2){
+    v.x * a.m[0][0] + v.y * a.m[1][0],
+    v.x * a.m[0][1] + v.y * a.m[1][1]
+  };
+}
+
+/* batched 2d affine functions */
+
+/**
+ * 2d affine matrix v2 array multiplication.
+ * transform n interleaved points by a. with sse2 two
+ * points are transformed per step.
+ *
+ * @param a shared a2
+ * @param v array of n v2
+ * @param out array of n v2, may be v
+ * @param n number of points
+ * @return void
+ */
+void a2xv2n(a2 a, const v2 *v, v2 *out, int n) {
+  int i = 0;
+  float x, y;
+#ifdef __SSE2__
+  /* two points per step, as x0 x0 x1 x1 and y0 y0 y1 y1 */
+  __m128 c0 = _mm_setr_ps(a.m[0][0], a.m[0][1], a.m[0][0], a.m[0][1]);
+  __m128 c1 = _mm_setr_ps(a.m[1][0], a.m[1][1], a.m[1][0], a.m[1][1]);
+  __m128 c2 = _mm_setr_ps(a.m[2][0], a.m[2][1], a.m[2][0], a.m[2][1]);
+  __m128 p, px, py;
+  for (; i + 2 <= n; i += 2) {
+    p = _mm_loadu_ps(&v[i].x);
+    px = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 0, 0));
+    py = _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 1, 1));
+    p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, c0), _mm_mul_ps(py, c1)), c2);
+    _mm_storeu_ps(&out[i].x, p);
+  }
+#endif
+  for (; i < n; i++) {
+    x = v[i].x;
+    y = v[i].y;
+    out[i].x = x * a.m[0][0] + y * a.m[1][0] + a.m[2][0];
+    out[i].y = x * a.m[0][1] + y * a.m[1][1] + a.m[2][1];
+  }
+}
+
+/**
+ * 2d affine matrix split array multiplication.
+ * transform n points stored as separate x and y arrays,
+ * each point only reads its own x and y. with sse2 four
+ * points are transformed per step.
+ *
+ * @param a shared a2
+ * @param x array of n x coordinates
+ * @param y array of n y coordinates
+ * @param ox array of n x coordinates out, may be x
+ * @param oy array of n y coordinates out, may be y
+ * @param n number of points
+ * @return void
+ */
+void a2xv2soa(a2 a, const float *x, const float *y,
+              float *ox, float *oy, int n) {
+  int i = 0;
+  float px, py;
+#ifdef __SSE2__
+  __m128 m00 = _mm_set1_ps(a.m[0][0]), m01 = _mm_set1_ps(a.m[0][1]);
+  __m128 m10 = _mm_set1_ps(a.m[1][0]), m11 = _mm_set1_ps(a.m[1][1]);
+  __m128 m20 = _mm_set1_ps(a.m[2][0]), m21 = _mm_set1_ps(a.m[2][1]);
+  __m128 vx, vy;
+  for (; i + 4 <= n; i += 4) {
+    vx = _mm_loadu_ps(x + i);
+    vy = _mm_loadu_ps(y + i);
+    _mm_storeu_ps(ox + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m00),
+                                                _mm_mul_ps(vy, m10)), m20));
+    _mm_storeu_ps(oy + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m01),
+                                                _mm_mul_ps(vy, m11)), m21));
+  }
+#endif
+  for (; i < n; i++) {
+    px = x[i];
+    py = y[i];
+    ox[i] = px * a.m[0][0] + py * a.m[1][0] + a.m[2][0];
+    oy[i] = px * a.m[0][1] + py * a.m[1][1] + a.m[2][1];
+  }
+}
+
+/*---- normal matrix functions ----*/
+
+/**
+ * matrix 3 vector 3 multiplication.
+ * transform v by m through right multiplication.
+ *
+ * @param m m3
+ * @param v v3
+ * @return v3 transformed vector
+ */
+v3 m3xv3(m3 m, v3 v) {
+  return (v3){
+    v.x * m.m[0][0] + v.y * m.m[1][0] + v.z * m.m[2][0],
+    v.x * m.m[0][1] + v.y * m.m[1][1] + v.z * m.m[2][1],
+    v.x * m.m[0][2] + v.y * m.m[1][2] + v.z * m.m[2][2]
+  };
+}
+
+/**
+ * normal matrix kernel.
+ * inverse transpose of the 3x3 whose rows are r[0..2].
+ * when the rows are orthogonal and of equal length, ie. a
+ * rotation with uniform scale, the result is just the input
+ * over its squared scale and the cofactors are skipped.
+ *
+ * @param r 3x3 linear part, row major
+ * @return m3 normal matrix
+ */
+static m3 nrmof(const float r[3][3]) {
+  m3 n;
+  int i, j;
+  float det;
+  float s0 = r[0][0] * r[0][0] + r[0][1] * r[0][1] + r[0][2] * r[0][2];
+  float s1 = r[1][0] * r[1][0] + r[1][1] * r[1][1] + r[1][2] * r[1][2];
+  float s2 = r[2][0] * r[2][0] + r[2][1] * r[2][1] + r[2][2] * r[2][2];
+  float d01 = r[0][0] * r[1][0] + r[0][1] * r[1][1] + r[0][2] * r[1][2];
+  float d02 = r[0][0] * r[2][0] + r[0][1] * r[2][1] + r[0][2] * r[2][2];
+  float d12 = r[1][0] * r[2][0] + r[1][1] * r[2][1] + r[1][2] * r[2][2];
+  float eps = 1e-5f * s0;
+  if (s0 > 0 &&
+      fabs(s1 - s0) <= eps && fabs(s2 - s0) <= eps &&
+      fabs(d01) <= eps && fabs(d02) <= eps && fabs(d12) <= eps) {
+    det = 1.0f / s0;
+    for (i = 0; i < 3; i++)
+      for (j = 0; j < 3; j++)
+        n.m[i][j] = r[i][j] * det;
+    return n;
+  }
+  /* cofactor rows are the cross products of the other two rows */
+  for (i = 0; i < 3; i++) {
+    const float *a = r[(i + 1) % 3];
+    const float *b = r[(i + 2) % 3];
+    n.m[i][0] = a[1] * b[2] - a[2] * b[1];
+    n.m[i][1] = a[2] * b[0] - a[0] * b[2];
+    n.m[i][2] = a[0] * b[1] - a[1] * b[0];
+  }
+  det = 1.0f / (
+    r[0][0] * n.m[0][0] +
+    r[0][1] * n.m[0][1] +
+    r[0][2] * n.m[0][2]
+  );
+  for (i = 0; i < 3; i++)
+    for (j = 0; j < 3; j++)
+      n.m[i][j] *= det;
+  return n;
+}
+
+/**
+ * m4 normal matrix.
+ * the inverse transpose of the upper 3x3 of m,
+ * which keeps normals perpendicular to surfaces under
+ * non uniform scale and shear, unlike m4invert.
+ *
+ * @param m an m4 with an invertible upper 3x3
+ * @return m3 to transform normals by
+ */
+m3 m4nrm(m4 m) {
+  float r[3][3];
+  int i;
+  for (i = 0; i < 3; i++) {
+    r[i][0] = m.m[i][0];
+    r[i][1] = m.m[i][1];
+    r[i][2] = m.m[i][2];
+  }
+  return nrmof((const float (*)[3])r);
+}
+
+/**
+ * a3 normal matrix.
+ * same as m4nrm for an affine matrix.
+ *
+ * @param a an a3 with an invertible linear part
+ * @return m3 to transform normals by
+ */
+m3 a3nrm(a3 a) {
+  return nrmof((const float (*)[3])a.m);
+}
+
+/**
+ * batched normal transform.
+ * transform n normals by a normal matrix and renormalize
+ * them in the same pass. zero length normals stay zero.
+ *
+ * @param m m3 from m4nrm or a3nrm
+ * @param v array of n v3 normals
+ * @param out array of n unit v3, may be v
+ * @param n number of normals
+ * @return void
+ */
+void m3nrmn(m3 m, const v3 *v, v3 *out, int n) {
+  int i;
+  float x, y, z, nx, ny, nz, len;
+  for (i = 0; i < n; i++) {
+    x = v[i].x;
+    y = v[i].y;
+    z = v[i].z;
+    nx = x * m.m[0][0] + y * m.m[1][0] + z * m.m[2][0];
+    ny = x * m.m[0][1] + y * m.m[1][1] + z * m.m[2][1];
+    nz = x * m.m[0][2] + y * m.m[1][2] + z * m.m[2][2];
+    len = nx * nx + ny * ny + nz * nz;
+    len = len > 0 ? 1.0f / sqrtf(len) : 0;
+    out[i].x = nx * len;
+    out[i].y = ny * len;
+    out[i].z = nz * len;
+  }
+}
+
+/*---- transform decomposition functions ----*/
+
+/**
+ * quaternion normalized lerp.
+ * interpolates along the shorter arc and renormalizes,
+ * cheaper than qslerp and close to it for small angles.
+ *
+ * @param a v4 unit quaternion
+ * @param b v4 unit quaternion
+ * @param t interpolation factor in [0, 1]
+ * @return v4 unit quaternion between a and b
+ */
+v4 qnlerp(v4 a, v4 b, float t) {
+  float d = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+  float u = 1.0f - t;
+  float len;
+  v4 q;
+  if (d < 0)
+    t = -t;
+  q.x = a.x * u + b.x * t;
+  q.y = a.y * u + b.y * t;
+  q.z = a.z * u + b.z * t;
+  q.w = a.w * u + b.w * t;
+  len = q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w;
+  len = len > 0 ? 1.0f / sqrtf(len) : 0;
+  return v4scl(q, len);
+}
+
+/**
+ * quaternion spherical lerp.
+ * constant angular velocity along the shorter arc,
+ * falls back to qnlerp when a and b are nearly parallel.
+ *
+ * @param a v4 unit quaternion
+ * @param b v4 unit quaternion
+ * @param t interpolation factor in [0, 1]
+ * @return v4 unit quaternion between a and b
+ */
+v4 qslerp(v4 a, v4 b, float t) {
+  float d = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+  float sign = 1;
+  float theta, st, wa, wb;
+  if (d < 0) {
+    d = -d;
+    sign = -1;
+  }
+  if (d > 0.9995f)
+    return qnlerp(a, b, t);
+  theta = acos(d);
+  st = 1.0f / sin(theta);
+  wa = sin((1.0f - t) * theta) * st;
+  wb = sin(t * theta) * st * sign;
+  return (v4){
+    a.x * wa + b.x * wb,
+    a.y * wa + b.y * wb,
+    a.z * wa + b.z * wb,
+    a.w * wa + b.w * wb
+  };
+}
+
+/**
+ * compose kernel.
+ * writes translation, unit quaternion rotation and
+ * per axis scale into an m4. rows 0-2 are the scaled
+ * images of the basis axes, row 3 the translation.
+ *
+ * @param t v3 translation
+ * @param q v4 unit quaternion
+ * @param s v3 scale
+ * @param out m4 to fill
+ */
+static void trsto(v3 t, v4 q, v3 s, m4 *out) {
+  float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+  float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+  float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+  out->m[0][0] = (1 - 2 * (yy + zz)) * s.x;
+  out->m[0][1] = (2 * (xy + wz)) * s.x;
+  out->m[0][2] = (2 * (xz - wy)) * s.x;
+  out->m[0][3] = 0;
+  out->m[1][0] = (2 * (xy - wz)) * s.y;
+  out->m[1][1] = (1 - 2 * (xx + zz)) * s.y;
+  out->m[1][2] = (2 * (yz + wx)) * s.y;
+  out->m[1][3] = 0;
+  out->m[2][0] = (2 * (xz + wy)) * s.z;
+  out->m[2][1] = (2 * (yz - wx)) * s.z;
+  out->m[2][2] = (1 - 2 * (xx + yy)) * s.z;
+  out->m[2][3] = 0;
+  out->m[3][0] = t.x;
+  out->m[3][1] = t.y;
+  out->m[3][2] = t.z;
+  out->m[3][3] = 1;
+}
+
+/**
+ * decompose an m4.
+ * splits an affine m into translation, rotation and scale.
+ * scale is the length of each basis row, a mirrored
+ * matrix gets a negative x scale. shear is not represented.
+ *
+ * @param m an affine m4
+ * @return trs with m == trstom4(result)
+ */
+trs m4totrs(m4 m) {
+  trs r;
+  float rx[3], ry[3], rz[3];
+  float det, tr, k;
+  int i;
+  r.t = (v3){m.m[3][0], m.m[3][1], m.m[3][2]};
+  r.s.x = sqrtf(m.m[0][0] * m.m[0][0] + m.m[0][1] * m.m[0][1] + m.m[0][2] * m.m[0][2]);
+  r.s.y = sqrtf(m.m[1][0] * m.m[1][0] + m.m[1][1] * m.m[1][1] + m.m[1][2] * m.m[1][2]);
+  r.s.z = sqrtf(m.m[2][0] * m.m[2][0] + m.m[2][1] * m.m[2][1] + m.m[2][2] * m.m[2][2]);
+  det =
+    m.m[0][0] * (m.m[1][1] * m.m[2][2] - m.m[1][2] * m.m[2][1]) -
+    m.m[0][1] * (m.m[1][0] * m.m[2][2] - m.m[1][2] * m.m[2][0]) +
+    m.m[0][2] * (m.m[1][0] * m.m[2][1] - m.m[1][1] * m.m[2][0]);
+  if (det < 0)
+    r.s.x = -r.s.x;
+  for (i = 0; i < 3; i++) {
+    rx[i] = r.s.x != 0 ? m.m[0][i] / r.s.x : 0;
+    ry[i] = r.s.y != 0 ? m.m[1][i] / r.s.y : 0;
+    rz[i] = r.s.z != 0 ? m.m[2][i] / r.s.z : 0;
+  }
+  /* largest pivot first to keep the divide well conditioned */
+  tr = rx[0] + ry[1] + rz[2];
+  if (tr > 0) {
+    k = 0.5f / sqrtf(tr + 1.0f);
+    r.q.w = 0.25f / k;
+    r.q.x = (ry[2] - rz[1]) * k;
+    r.q.y = (rz[0] - rx[2]) * k;
+    r.q.z = (rx[1] - ry[0]) * k;
+  } else if (rx[0] > ry[1] && rx[0] > rz[2]) {
+    k = 0.5f / sqrtf(1.0f + rx[0] - ry[1] - rz[2]);
+    r.q.w = (ry[2] - rz[1]) * k;
+    r.q.x = 0.25f / k;
+    r.q.y = (ry[0] + rx[1]) * k;
+    r.q.z = (rz[0] + rx[2]) * k;
+  } else if (ry[1] > rz[2]) {
+    k = 0.5f / sqrtf(1.0f + ry[1] - rx[0] - rz[2]);
+    r.q.w = (rz[0] - rx[2]) * k;
+    r.q.x = (ry[0] + rx[1]) * k;
+    r.q.y = 0.25f / k;
+    r.q.z = (rz[1] + ry[2]) * k;
+  } else {
+    k = 0.5f / sqrtf(1.0f + rz[2] - rx[0] - ry[1]);
+    r.q.w = (rx[1] - ry[0]) * k;
+    r.q.x = (rz[0] + rx[2]) * k;
+    r.q.y = (rz[1] + ry[2]) * k;
+    r.q.z = 0.25f / k;
+  }
+  return r;
+}
+
+/**
+ * compose an m4.
+ * inverse of m4totrs, scale then rotate then translate.
+ *
+ * @param x trs with a unit quaternion
+ * @return affine m4
+ */
+m4 trstom4(trs x) {
+  m4 m;
+  trsto(x.t, x.q, x.s, &m);
+  return m;
+}
+
+/**
+ * batched m4 decomposition.
+ * eg. convert keyframe matrices once before sampling.
+ *
+ * @param m array of n affine m4
+ * @param out array of n trs
+ * @param n number of matrices
+ * @return void
+ */
+void m4totrsn(const m4 *m, trs *out, int n) {
+  int i;
+  for (i = 0; i < n; i++)
+    out[i] = m4totrs(m[i]);
+}
+
+/**
+ * batched transform interpolation.
+ * lerps translation and scale, nlerps or slerps rotation
+ * and writes the composed m4 in the same pass.
+ *
+ * @param a array of n trs at t = 0
+ * @param b array of n trs at t = 1
+ * @param t interpolation factor in [0, 1]
+ * @param slerp nonzero to slerp rotations instead of nlerp
+ * @param out array of n m4
+ * @param n number of transforms
+ * @return void
+ */
+void trslerpn(const trs *a, const trs *b, float t, int slerp, m4 *out, int n) {
+  int i;
+  float u = 1.0f - t;
+  v3 tt, ss;
+  v4 q;
+  for (i = 0; i < n; i++) {
+    tt.x = a[i].t.x * u + b[i].t.x * t;
+    tt.y = a[i].t.y * u + b[i].t.y * t;
+    tt.z = a[i].t.z * u + b[i].t.z * t;
+    ss.x = a[i].s.x * u + b[i].s.x * t;
+    ss.y = a[i].s.y * u + b[i].s.y * t;
+    ss.z = a[i].s.z * u + b[i].s.z * t;
+    q = slerp ? qslerp(a[i].q, b[i].q, t) : qnlerp(a[i].q, b[i].q, t);
+    trsto(tt, q, ss, &out[i]);
+  }
+}
+
+/*---- k-d tree functions ----*/
+
+#define KDLEAF 8
+
+/**
+ * k-d tree swap.
+ * exchange two points and their source indices.
+ */
+static void kdswap(kdtree *t, int a, int b) {
+  int i, d = t->dim;
+  float f;
+  for (i = 0; i < d; i++) {
+    f = t->p[a * d + i];
+    t->p[a * d + i] = t->p[b * d + i];
+    t->p[b * d + i] = f;
+  }
+  i = t->idx[a];
+  t->idx[a] = t->idx[b];
+  t->idx[b] = i;
+}
+
+/**
+ * k-d tree select.
+ * partial sort [lo, hi) so the point at mid has the median
+ * coordinate on axis, with none larger before it and none
+ * smaller after it. hoare partitioning keeps runs of equal
+ * coordinates from going quadratic.
+ */
+static void kdselect(kdtree *t, int lo, int hi, int mid, int axis) {
+  int d = t->dim;
+  int i, j;
+  float pivot;
+  hi--;
+  while (lo < hi) {
+    pivot = t->p[mid * d + axis];
+    i = lo;
+    j = hi;
+    while (i <= j) {
+      while (t->p[i * d + axis] < pivot)
+        i++;
+      while (t->p[j * d + axis] > pivot)
+        j--;
+      if (i <= j)
+        kdswap(t, i++, j--);
+    }
+    if (mid <= j)
+      hi = j;
+    else if (mid >= i)
+      lo = i;
+    else
+      return;
+  }
+}
+
+/**
+ * k-d tree split.
+ * median split [lo, hi) on its widest axis and recurse.
+ * ranges of KDLEAF points or less are left as leaf buckets.
+ */
+static void kdsplit(kdtree *t, int lo, int hi) {
+  int d = t->dim;
+  int i, j, axis, mid;
+  float mn[3], mx[3], c;
+  if (hi - lo <= KDLEAF)
+    return;
+  for (j = 0; j < d; j++)
+    mn[j] = mx[j] = t->p[lo * d + j];
+  for (i = lo + 1; i < hi; i++)
+    for (j = 0; j < d; j++) {
+      c = t->p[i * d + j];
+      mn[j] = c < mn[j] ? c : mn[j];
+      mx[j] = c > mx[j] ? c : mx[j];
+    }
+  axis = 0;
+  for (j = 1; j < d; j++)
+    if (mx[j] - mn[j] > mx[axis] - mn[axis])
+      axis = j;
+  mid = lo + (hi - lo) / 2;
+  kdselect(t, lo, hi, mid, axis);
+  t->axis[mid] = axis;
+  kdsplit(t, lo, mid);
+  kdsplit(t, mid + 1, hi);
+}
+
+/**
+ * k-d tree build core.
+ * copies n points of dim floats each from base, stride bytes apart.
+ */
+static kdtree kdmake(const float *base, int stride, int dim, int n) {
+  kdtree t;
+  int i, j;
+  t.dim = dim;
+  t.n = n;
+  t.p = malloc(sizeof(float) * dim * (n > 0 ? n : 1));
+  t.idx = malloc(sizeof(int) * (n > 0 ? n : 1));
+  t.axis = malloc(n > 0 ? n : 1);
+  if (!t.p || !t.idx || !t.axis) {
+    kdfree(&t);
+    return t;
+  }
+  for (i = 0; i < n; i++) {
+    const float *s = (const float *)((const char *)base + (size_t)i * stride);
+    for (j = 0; j < dim; j++)
+      t.p[i * dim + j] = s[j];
+    t.idx[i] = i;
+  }
+  kdsplit(&t, 0, n);
+  return t;
+}
+
+/**
+ * k-d tree from v2 points.
+ * points are copied into tree order, p can be freed after.
+ *
+ * @param p array of n v2
+ * @param n number of points
+ * @return kdtree, empty with NULL arrays if allocation fails
+ */
+kdtree kdbuild2(const v2 *p, int n) {
+  return kdmake(&p->x, sizeof(v2), 2, n);
+}
+
+/**
+ * k-d tree from v3 points.
+ * points are copied into tree order, p can be freed after.
+ *
+ * @param p array of n v3
+ * @param n number of points
+ * @return kdtree, empty with NULL arrays if allocation fails
+ */
+kdtree kdbuild3(const v3 *p, int n) {
+  return kdmake(&p->x, sizeof(v3), 3, n);
+}
+
+/**
+ * free a k-d tree.
+ * leaves t empty, safe to call twice.
+ *
+ * @param t kdtree
+ * @return void
+ */
+void kdfree(kdtree *t) {
+  free(t->p);
+  free(t->idx);
+  free(t->axis);
+  t->p = NULL;
+  t->idx = NULL;
+  t->axis = NULL;
+  t->n = 0;
+}
+
+/* k-d tree query state */
+typedef struct kdq {
+  const kdtree *t;
+  float q[3];
+  float r2;
+  int k, cnt, max;
+  int *idx;
+  float *d2;
+} kdq;
+
+/** squared distance from the query to tree point i */
+static float kddist(const kdq *s, int i) {
+  const float *p = s->t->p + i * s->t->dim;
+  float d, sum = 0;
+  int j;
+  for (j = 0; j < s->t->dim; j++) {
+    d = p[j] - s->q[j];
+    sum += d * d;
+  }
+  return sum;
+}
+
+/**
+ * k nearest candidate.
+ * idx and d2 hold a max heap on d2 of at most k entries,
+ * r2 tracks the current kth distance once it is full.
+ */
+static void kdpush(kdq *s, int i, float d2) {
+  int c, p;
+  if (s->cnt < s->k) {
+    c = s->cnt++;
+    while (c > 0 && s->d2[p = (c - 1) / 2] < d2) {
+      s->d2[c] = s->d2[p];
+      s->idx[c] = s->idx[p];
+      c = p;
+    }
+  } else {
+    if (d2 >= s->d2[0])
+      return;
+    for (p = 0; (c = 2 * p + 1) < s->cnt; p = c) {
+      if (c + 1 < s->cnt && s->d2[c + 1] > s->d2[c])
+        c++;
+      if (s->d2[c] <= d2)
+        break;
+      s->d2[p] = s->d2[c];
+      s->idx[p] = s->idx[c];
+    }
+    c = p;
+  }
+  s->d2[c] = d2;
+  s->idx[c] = i;
+  if (s->cnt == s->k)
+    s->r2 = s->d2[0];
+}
+
+/** k nearest descent over tree range [lo, hi) */
+static void kdknnr(kdq *s, int lo, int hi) {
+  int i, mid, a;
+  float diff, d2;
+  if (hi - lo <= KDLEAF) {
+    for (i = lo; i < hi; i++)
+      if ((d2 = kddist(s, i)) < s->r2)
+        kdpush(s, i, d2);
+    return;
+  }
+  mid = lo + (hi - lo) / 2;
+  a = s->t->axis[mid];
+  diff = s->q[a] - s->t->p[mid * s->t->dim + a];
+  if ((d2 = kddist(s, mid)) < s->r2)
+    kdpush(s, mid, d2);
+  if (diff < 0) {
+    kdknnr(s, lo, mid);
+    if (diff * diff < s->r2)
+      kdknnr(s, mid + 1, hi);
+  } else {
+    kdknnr(s, mid + 1, hi);
+    if (diff * diff < s->r2)
+      kdknnr(s, lo, mid);
+  }
+}
+
+/** radius descent over tree range [lo, hi) */
+static void kdradr(kdq *s, int lo, int hi) {
+  int i, mid, a;
+  float diff;
+  if (hi - lo <= KDLEAF) {
+    for (i = lo; i < hi; i++)
+      if (kddist(s, i) <= s->r2) {
+        if (s->cnt < s->max)
+          s->idx[s->cnt] = s->t->idx[i];
+        s->cnt++;
+      }
+    return;
+  }
+  mid = lo + (hi - lo) / 2;
+  a = s->t->axis[mid];
+  diff = s->q[a] - s->t->p[mid * s->t->dim + a];
+  if (kddist(s, mid) <= s->r2) {
+    if (s->cnt < s->max)
+      s->idx[s->cnt] = s->t->idx[mid];
+    s->cnt++;
+  }
+  if (diff <= 0 || diff * diff <= s->r2)
+    kdradr(s, lo, mid);
+  if (diff >= 0 || diff * diff <= s->r2)
+    kdradr(s, mid + 1, hi);
+}
+
+/**
+ * k nearest core.
+ * sorts the heap ascending and maps tree slots to source indices.
+ */
+static int kdsearch(const kdtree *t, const float *q, int k, int *idx, float *d2) {
+  kdq s;
+  int i, c, p, n, last;
+  float fd;
+  s.t = t;
+  s.q[0] = q[0];
+  s.q[1] = q[1];
+  s.q[2] = q[2];
+  s.r2 = HUGE_VAL;
+  s.k = k;
+  s.cnt = 0;
+  s.idx = idx;
+  s.d2 = d2;
+  if (k <= 0 || t->n <= 0)
+    return 0;
+  kdknnr(&s, 0, t->n);
+  /* never more than k, spelled out so k = 1 callers stay in bounds */
+  n = s.cnt < k ? s.cnt : k;
+  /* heap sort in place, largest to the back */
+  for (last = n - 1; last > 0; last--) {
+    fd = d2[last];
+    c = idx[last];
+    d2[last] = d2[0];
+    idx[last] = idx[0];
+    for (p = 0; (i = 2 * p + 1) < last; p = i) {
+      if (i + 1 < last && d2[i + 1] > d2[i])
+        i++;
+      if (d2[i] <= fd)
+        break;
+      d2[p] = d2[i];
+      idx[p] = idx[i];
+    }
+    d2[p] = fd;
+    idx[p] = c;
+  }
+  for (i = 0; i < n; i++)
+    idx[i] = t->idx[idx[i]];
+  return n;
+}
+
+/** radius core, see kdradius3 */
+static int kdball(const kdtree *t, const float *q, float r, int *idx, int max) {
+  kdq s;
+  s.t = t;
+  s.q[0] = q[0];
+  s.q[1] = q[1];
+  s.q[2] = q[2];
+  s.r2 = r * r;
+  s.cnt = 0;
+  s.max = max;
+  s.idx = idx;
+  if (t->n > 0)
+    kdradr(&s, 0, t->n);
+  return s.cnt;
+}
+
+/**
+ * k nearest v2 query.
+ * distances are compared squared, no sqrt is taken.
+ *
+ * @param t kdtree from kdbuild2
+ * @param q v2 query point
+ * @param k number of neighbours wanted
+ * @param idx array of k source indices out, nearest first
+ * @param d2 array of k squared distances out
+ * @return number of neighbours found, at most k
+ */
+int kdknn2(const kdtree *t, v2 q, int k, int *idx, float *d2) {
+  float f[3];
+  f[0] = q.x;
+  f[1] = q.y;
+  f[2] = 0;
+  return kdsearch(t, f, k, idx, d2);
+}
+
+/**
+ * k nearest v3 query.
+ * distances are compared squared, no sqrt is taken.
+ *
+ * @param t kdtree from kdbuild3
+ * @param q v3 query point
+ * @param k number of neighbours wanted
+ * @param idx array of k source indices out, nearest first
+ * @param d2 array of k squared distances out
+ * @return number of neighbours found, at most k
+ */
+int kdknn3(const kdtree *t, v3 q, int k, int *idx, float *d2) {
+  float f[3];
+  f[0] = q.x;
+  f[1] = q.y;
+  f[2] = q.z;
+  return kdsearch(t, f, k, idx, d2);
+}
+
+/**
+ * v2 radius query.
+ *
+ * @param t kdtree from kdbuild2
+ * @param q v2 query point
+ * @param r search radius
+ * @param idx array of max source indices out, unordered
+ * @param max capacity of idx
+ * @return number of points within r, may exceed max
+ */
+int kdradius2(const kdtree *t, v2 q, float r, int *idx, int max) {
+  float f[3];
+  f[0] = q.x;
+  f[1] = q.y;
+  f[2] = 0;
+  return kdball(t, f, r, idx, max);
+}
+
+/**
+ * v3 radius query.
+ *
+ * @param t kdtree from kdbuild3
+ * @param q v3 query point
+ * @param r search radius
+ * @param idx array of max source indices out, unordered
+ * @param max capacity of idx
+ * @return number of points within r, may exceed max
+ */
+int kdradius3(const kdtree *t, v3 q, float r, int *idx, int max) {
+  float f[3];
+  f[0] = q.x;
+  f[1] = q.y;
+  f[2] = q.z;
+  return kdball(t, f, r, idx, max);
+}
+
+/**
+ * batched k nearest v3 query.
+ * rows with fewer than k neighbours are padded
+ * with index -1 and distance HUGE_VAL.
+ *
+ * @param t kdtree from kdbuild3
+ * @param q array of m v3 query points
+ * @param m number of queries
+ * @param k neighbours per query
+ * @param idx array of m * k source indices out
+ * @param d2 array of m * k squared distances out
+ * @return void
+ */
+void kdknnn3(const kdtree *t, const v3 *q, int m, int k, int *idx, float *d2) {
+  int i, j, c;
+  for (i = 0; i < m; i++) {
+    c = kdknn3(t, q[i], k, idx + i * k, d2 + i * k);
+    for (j = c; j < k; j++) {
+      idx[i * k + j] = -1;
+      d2[i * k + j] = HUGE_VAL;
+    }
+  }
+}
+
+/**
+ * batched v3 radius query.
+ * results are packed back to back, query i owns
+ * idx[start[i]] up to idx[start[i + 1]].
+ *
+ * @param t kdtree from kdbuild3
+ * @param q array of m v3 query points
+ * @param m number of queries
+ * @param r search radius
+ * @param idx array of max source indices out
+ * @param start array of m + 1 offsets into idx
+ * @param max capacity of idx
+ * @return total number of matches, if above max
+ *         the offsets are valid but idx is truncated
+ */
+int kdradiusn3(const kdtree *t, const v3 *q, int m, float r,
+               int *idx, int *start, int max) {
+  int i, total = 0;
+  for (i = 0; i < m; i++) {
+    start[i] = total;
+    total += kdradius3(t, q[i], r, idx + (total < max ? total : max),
+                       total < max ? max - total : 0);
+  }
+  start[m] = total;
+  return total;
+}
+
+/*---- spatial hash grid functions ----*/
+
+/** hash integer cell coordinates */
+static unsigned hgkey(int x, int y, int z) {
+  return ((unsigned)x * 73856093u) ^
+         ((unsigned)y * 19349663u) ^
+         ((unsigned)z * 83492791u);
+}
+
+/* cell coordinates are clamped to +-2^30 so huge points stay in int */
+#define HGMAXCELL 1073741824.0
+
+/** cell coordinate of c along one axis */
+static int hgcell(const hgrid *g, float c) {
+  double f = floor(c * g->inv);
+  return f < HGMAXCELL ? (f > -HGMAXCELL ? (int)f : -(int)HGMAXCELL)
+                       : (int)HGMAXCELL;
+}
+
+/**
+ * new spatial hash grid.
+ * the grid starts empty, fill it with hgbuild2 or hgbuild3
+ * and rebuild it in place every frame as points move.
+ * a cell near the typical query radius works best.
+ *
+ * @param dim 2 or 3
+ * @param cell cell edge length
+ * @param ncell number of hash buckets, rounded up to a power of 2
+ * @return hgrid, with NULL start if allocation fails
+ */
+hgrid hgnew(int dim, float cell, int ncell) {
+  hgrid g;
+  int b = 1;
+  while (b < ncell)
+    b <<= 1;
+  g.dim = dim;
+  g.n = 0;
+  g.cap = 0;
+  g.nbucket = b;
+  g.cell = cell;
+  g.inv = 1.0f / cell;
+  g.start = calloc(b + 1, sizeof(int));
+  g.idx = NULL;
+  g.p = NULL;
+  g.h = NULL;
+  return g;
+}
+
+/**
+ * free a spatial hash grid.
+ *
+ * @param g hgrid
+ * @return void
+ */
+void hgfree(hgrid *g) {
+  free(g->start);
+  free(g->idx);
+  free(g->p);
+  free(g->h);
+  g->start = NULL;
+  g->idx = NULL;
+  g->p = NULL;
+  g->h = NULL;
+  g->n = g->cap = 0;
+}
+
+/**
+ * spatial hash grid rebuild core.
+ * counting sort of the points by bucket, O(n + buckets).
+ * positions are copied in bucket order so every
+ * bucket is one contiguous run of g->p.
+ */
+static int hgbuild(hgrid *g, const float *base, int stride, int n) {
+  int i, j, b, d = g->dim;
+  int *ip;
+  float *fp;
+  unsigned *hp;
+  const float *s;
+  if (!g->start)
+    return 0;
+  if (n > g->cap) {
+    ip = realloc(g->idx, sizeof(int) * n);
+    if (ip)
+      g->idx = ip;
+    fp = realloc(g->p, sizeof(float) * d * n);
+    if (fp)
+      g->p = fp;
+    hp = realloc(g->h, sizeof(unsigned) * n);
+    if (hp)
+      g->h = hp;
+    if (!ip || !fp || !hp)
+      return 0;
+    g->cap = n;
+  }
+  g->n = n;
+  for (b = 0; b <= g->nbucket; b++)
+    g->start[b] = 0;
+  for (i = 0; i < n; i++) {
+    s = (const float *)((const char *)base + (size_t)i * stride);
+    g->h[i] = hgkey(
+      hgcell(g, s[0]),
+      hgcell(g, s[1]),
+      d > 2 ? hgcell(g, s[2]) : 0
+    ) & (g->nbucket - 1);
+    g->start[g->h[i] + 1]++;
+  }
+  for (b = 0; b < g->nbucket; b++)
+    g->start[b + 1] += g->start[b];
+  /* scatter using start as a cursor, then shift it back */
+  for (i = 0; i < n; i++) {
+    s = (const float *)((const char *)base + (size_t)i * stride);
+    b = g->start[g->h[i]]++;
+    g->idx[b] = i;
+    for (j = 0; j < d; j++)
+      g->p[b * d + j] = s[j];
+  }
+  for (b = g->nbucket; b > 0; b--)
+    g->start[b] = g->start[b - 1];
+  g->start[0] = 0;
+  return 1;
+}
+
+/**
+ * rebuild a spatial hash grid from v2 points.
+ *
+ * @param g hgrid from hgnew with dim 2
+ * @param p array of n v2
+ * @param n number of points
+ * @return 1 on success, 0 if g is not dim 2 or allocation fails
+ */
+int hgbuild2(hgrid *g, const v2 *p, int n) {
+  if (g->dim != 2)
+    return 0;
+  return hgbuild(g, &p->x, sizeof(v2), n);
+}
+
+/**
+ * rebuild a spatial hash grid from v3 points.
+ *
+ * @param g hgrid from hgnew with dim 3
+ * @param p array of n v3
+ * @param n number of points
+ * @return 1 on success, 0 if g is not dim 3 or allocation fails
+ */
+int hgbuild3(hgrid *g, const v3 *p, int n) {
+  if (g->dim != 3)
+    return 0;
+  return hgbuild(g, &p->x, sizeof(v3), n);
+}
+
+/** squared distance test of slot s against q */
+static int hgnear(const hgrid *g, const float *q, float r2, int s) {
+  const float *p = g->p + s * g->dim;
+  float dx = p[0] - q[0], dy = p[1] - q[1];
+  float dz = g->dim > 2 ? p[2] - q[2] : 0;
+  return dx * dx + dy * dy + dz * dz <= r2;
+}
+
+/** write slot s as hit cnt, paired with self when self >= 0 */
+static void hgout(const hgrid *g, int self, int s, int *out, int cnt,
+                  int max) {
+  if (cnt >= max)
+    return;
+  if (self >= 0) {
+    out[2 * cnt] = g->idx[self];
+    out[2 * cnt + 1] = g->idx[s];
+  } else {
+    out[cnt] = g->idx[s];
+  }
+}
+
+/**
+ * spatial hash grid neighbourhood scan.
+ * visits every cell overlapping the box around q and tests
+ * the run of its bucket with squared distances. a bucket can
+ * be shared by several cells, so hits are only kept from
+ * the cell being visited. a box spanning more cells than
+ * there are buckets is answered by one linear pass over the
+ * points instead. with self >= 0 only slots after self are
+ * kept and written as pairs with it. r must be finite.
+ */
+static int hgscan(const hgrid *g, const float *q, float r,
+                  int self, int *out, int max) {
+  int d = g->dim;
+  int lo[3], hi[3], c[3];
+  int j, s, e, cnt = 0;
+  float r2 = r * r;
+  double span = 1;
+  if (!(r >= 0 && r < HUGE_VAL))
+    return 0;
+  for (j = 0; j < 3; j++) {
+    lo[j] = j < d ? hgcell(g, q[j] - r) : 0;
+    hi[j] = j < d ? hgcell(g, q[j] + r) : 0;
+    span *= (double)hi[j] - lo[j] + 1;
+  }
+  if (span > g->nbucket) {
+    for (s = self + 1; s < g->n; s++)
+      if (hgnear(g, q, r2, s))
+        hgout(g, self, s, out, cnt++, max);
+    return cnt;
+  }
+  for (c[2] = lo[2]; c[2] <= hi[2]; c[2]++)
+    for (c[1] = lo[1]; c[1] <= hi[1]; c[1]++)
+      for (c[0] = lo[0]; c[0] <= hi[0]; c[0]++) {
+        j = hgkey(c[0], c[1], c[2]) & (g->nbucket - 1);
+        e = g->start[j + 1];
+        for (s = g->start[j] > self ? g->start[j] : self + 1; s < e; s++) {
+          if (!hgnear(g, q, r2, s))
+            continue;
+          if (hgcell(g, g->p[s * d]) != c[0] ||
+              hgcell(g, g->p[s * d + 1]) != c[1] ||
+              (d > 2 && hgcell(g, g->p[s * d + 2]) != c[2]))
+            continue;
+          hgout(g, self, s, out, cnt++, max);
+        }
+      }
+  return cnt;
+}
+
+/**
+ * v2 spatial hash grid radius query.
+ *
+ * @param g hgrid built with hgbuild2
+ * @param q v2 query point
+ * @param r search radius, non finite radii find nothing
+ * @param idx array of max source indices out, unordered
+ * @param max capacity of idx
+ * @return number of points within r, may exceed max
+ */
+int hgradius2(const hgrid *g, v2 q, float r, int *idx, int max) {
+  float f[3];
+  f[0] = q.x;
+  f[1] = q.y;
+  f[2] = 0;
+  return hgscan(g, f, r, -1, idx, max);
+}
+
+/**
+ * v3 spatial hash grid radius query.
+ *
+ * @param g hgrid built with hgbuild3
+ * @param q v3 query point
+ * @param r search radius, non finite radii find nothing
+ * @param idx array of max source indices out, unordered
+ * @param max capacity of idx
+ * @return number of points within r, may exceed max
+ */
+int hgradius3(const hgrid *g, v3 q, float r, int *idx, int max) {
+  float f[3];
+  f[0] = q.x;
+  f[1] = q.y;
+  f[2] = q.z;
+  return hgscan(g, f, r, -1, idx, max);
+}
+
+/**
+ * all neighbour pairs within r.
+ * walks the points in bucket order so positions are read
+ * contiguously, and reports each unordered pair once.
+ *
+ * @param g built hgrid
+ * @param r pair distance, non finite distances find nothing
+ * @param pairs array of 2 * max source indices out
+ * @param max capacity of pairs in pairs
+ * @return number of pairs within r, may exceed max
+ */
+int hgpairs(const hgrid *g, float r, int *pairs, int max) {
+  int s, cnt = 0;
+  for (s = 0; s < g->n; s++)
+    cnt += hgscan(g, g->p + s * g->dim, r, s,
+                  pairs + 2 * (cnt < max ? cnt : max),
+                  cnt < max ? max - cnt : 0);
+  return cnt;
+}
+
+/*---- pairwise distance functions ----*/
+
+#define DTILE 64
+
+#ifndef __AVX__
+/** distances from q to points j to m of a split tile, plain c */
+static void distrun(const float *q, float (*t)[DTILE], int j, int m,
+                    int root, float *o) {
+  float dx, dy, dz, dw, d;
+  for (; j < m; j++) {
+    dx = q[0] - t[0][j];
+    dy = q[1] - t[1][j];
+    dz = q[2] - t[2][j];
+    dw = q[3] - t[3][j];
+    d = dx * dx + dy * dy + dz * dz + dw * dw;
+    o[j] = root ? sqrtf(d) : d;
+  }
+}
+#endif
+
+/**
+ * distances from q to the first m points of a split tile.
+ * with avx 8 points are done per step and the last step
+ * is a masked store over the zero padded tile, so the
+ * row never drops to the libm sqrtf with dirty upper
+ * state. with sse2 4 points are done per step and the
+ * rest go through distrun.
+ */
+#if defined(__AVX__)
+static void distrow(const float *q, float (*t)[DTILE], int m, int root,
+                    float *o) {
+  __m256 qx = _mm256_set1_ps(q[0]), qy = _mm256_set1_ps(q[1]);
+  __m256 qz = _mm256_set1_ps(q[2]), qw = _mm256_set1_ps(q[3]);
+  __m256 ramp = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256 dx, dy, dz, dw, d;
+  int j;
+  for (j = 0; j < m; j += 8) {
+    dx = _mm256_sub_ps(qx, _mm256_loadu_ps(t[0] + j));
+    dy = _mm256_sub_ps(qy, _mm256_loadu_ps(t[1] + j));
+    dz = _mm256_sub_ps(qz, _mm256_loadu_ps(t[2] + j));
+    dw = _mm256_sub_ps(qw, _mm256_loadu_ps(t[3] + j));
+    d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx),
+                                    _mm256_mul_ps(dy, dy)),
+                      _mm256_add_ps(_mm256_mul_ps(dz, dz),
+                                    _mm256_mul_ps(dw, dw)));
+    if (root)
+      d = _mm256_sqrt_ps(d);
+    if (j + 8 <= m)
+      _mm256_storeu_ps(o + j, d);
+    else
+      _mm256_maskstore_ps(o + j, _mm256_castps_si256(_mm256_cmp_ps(
+          ramp, _mm256_set1_ps((float)(m - j)), _CMP_LT_OQ)), d);
+  }
+}
+#elif defined(__SSE2__)
+static void distrow(const float *q, float (*t)[DTILE], int m, int root,
+                    float *o) {
+  __m128 qx = _mm_set1_ps(q[0]), qy = _mm_set1_ps(q[1]);
+  __m128 qz = _mm_set1_ps(q[2]), qw = _mm_set1_ps(q[3]);
+  __m128 dx, dy, dz, dw, d;
+  int j;
+  for (j = 0; j + 4 <= m; j += 4) {
+    dx = _mm_sub_ps(qx, _mm_loadu_ps(t[0] + j));
+    dy = _mm_sub_ps(qy, _mm_loadu_ps(t[1] + j));
+    dz = _mm_sub_ps(qz, _mm_loadu_ps(t[2] + j));
+    dw = _mm_sub_ps(qw, _mm_loadu_ps(t[3] + j));
+    d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                   _mm_add_ps(_mm_mul_ps(dz, dz), _mm_mul_ps(dw, dw)));
+    _mm_storeu_ps(o + j, root ? _mm_sqrt_ps(d) : d);
+  }
+  distrun(q, t, j, m, root, o);
+}
+#else
+static void distrow(const float *q, float (*t)[DTILE], int m, int root,
+                    float *o) {
+  distrun(q, t, 0, m, root, o);
+}
+#endif
+
+/**
+ * copy m points of stride s from p into a split tile.
+ * w is 0 below dim 4, and the tile is zero padded to a
+ * multiple of 8 points.
+ */
+static void distload(float (*t)[DTILE], const float *p, int s, int m,
+                     int dim) {
+  int j;
+  for (j = 0; j < m; j++, p += s) {
+    t[0][j] = p[0];
+    t[1][j] = p[1];
+    t[2][j] = p[2];
+    t[3][j] = dim > 3 ? p[3] : 0;
+  }
+  for (; j & 7; j++)
+    t[0][j] = t[1][j] = t[2][j] = t[3][j] = 0;
+}
+
+/**
+ * pairwise distance core.
+ * b is walked in tiles of DTILE points copied to split
+ * x, y, z, w arrays, every point of a is run against the
+ * tile with distrow, then the next tile is loaded.
+ * direct differences are used rather than the expanded
+ * |a|^2 + |b|^2 - 2a.b form, which costs the same at this
+ * width and does not cancel for close points.
+ */
+static void distmat(const float *a, int sa, int na,
+                    const float *b, int sb, int nb,
+                    int dim, float *out, int root) {
+  float t[4][DTILE], q[4];
+  const float *p;
+  int i, j0, m;
+  for (j0 = 0; j0 < nb; j0 += DTILE) {
+    m = nb - j0 < DTILE ? nb - j0 : DTILE;
+    distload(t, b + (size_t)j0 * sb, sb, m, dim);
+    for (i = 0; i < na; i++) {
+      p = a + (size_t)i * sa;
+      q[0] = p[0];
+      q[1] = p[1];
+      q[2] = p[2];
+      q[3] = dim > 3 ? p[3] : 0;
+      distrow(q, t, m, root, out + (size_t)i * nb + j0);
+    }
+  }
+}
+
+/**
+ * thresholded pairs core.
+ * same tiling as distmat, each row of squared distances
+ * goes to a scratch row and only pairs of at most r * r
+ * are written out. when a and b are the same array only
+ * pairs with i < j are kept.
+ */
+static int distpairs(const float *a, int sa, int na,
+                     const float *b, int sb, int nb,
+                     int dim, float r, int *pairs, int max) {
+  float t[4][DTILE], q[4], d[DTILE];
+  float r2 = r * r;
+  const float *p;
+  int i, j, j0, m, cnt = 0;
+  int self = a == b && sa == sb && na == nb;
+  for (j0 = 0; j0 < nb; j0 += DTILE) {
+    m = nb - j0 < DTILE ? nb - j0 : DTILE;
+    distload(t, b + (size_t)j0 * sb, sb, m, dim);
+    for (i = 0; i < (self ? j0 + m : na); i++) {
+      p = a + (size_t)i * sa;
+      q[0] = p[0];
+      q[1] = p[1];
+      q[2] = p[2];
+      q[3] = dim > 3 ? p[3] : 0;
+      distrow(q, t, m, 0, d);
+      for (j = self && i >= j0 ? i - j0 + 1 : 0; j < m; j++)
+        if (d[j] <= r2) {
+          if (cnt < max) {
+            pairs[2 * cnt] = i;
+            pairs[2 * cnt + 1] = j0 + j;
+          }
+          cnt++;
+        }
+    }
+  }
+  return cnt;
+}
+
+/**
+ * v3 distance matrix.
+ * distance from every point of a to every point of b.
+ *
+ * @param a array of na v3
+ * @param na number of points in a
+ * @param b array of nb v3
+ * @param nb number of points in b
+ * @param out na * nb floats, row i holds the distances from a[i]
+ * @param root nonzero for true distances, zero for squared
+ * @return void
+ */
+void v3distmat(const v3 *a, int na, const v3 *b, int nb, float *out, int root) {
+  distmat(&a->x, 3, na, &b->x, 3, nb, 3, out, root);
+}
+
+/**
+ * v4 distance matrix.
+ * distance from every point of a to every point of b.
+ *
+ * @param a array of na v4
+ * @param na number of points in a
+ * @param b array of nb v4
+ * @param nb number of points in b
+ * @param out na * nb floats, row i holds the distances from a[i]
+ * @param root nonzero for true distances, zero for squared
+ * @return void
+ */
+void v4distmat(const v4 *a, int na, const v4 *b, int nb, float *out, int root) {
+  distmat(&a->x, 4, na, &b->x, 4, nb, 4, out, root);
+}
+
+/**
+ * v3 pairs within a distance.
+ * pass the same array as a and b for a self join,
+ * each unordered pair is then reported once.
+ *
+ * @param a array of na v3
+ * @param na number of points in a
+ * @param b array of nb v3
+ * @param nb number of points in b
+ * @param r pair distance
+ * @param pairs array of 2 * max indices out, (index in a, index in b)
+ * @param max capacity of pairs in pairs
+ * @return number of pairs within r, may exceed max
+ */
+int v3within(const v3 *a, int na, const v3 *b, int nb,
+             float r, int *pairs, int max) {
+  return distpairs(&a->x, 3, na, &b->x, 3, nb, 3, r, pairs, max);
+}
+
+/**
+ * v4 pairs within a distance.
+ * pass the same array as a and b for a self join,
+ * each unordered pair is then reported once.
+ *
+ * @param a array of na v4
+ * @param na number of points in a
+ * @param b array of nb v4
+ * @param nb number of points in b
+ * @param r pair distance
+ * @param pairs array of 2 * max indices out, (index in a, index in b)
+ * @param max capacity of pairs in pairs
+ * @return number of pairs within r, may exceed max
+ */
+int v4within(const v4 *a, int na, const v4 *b, int nb,
+             float r, int *pairs, int max) {
+  return distpairs(&a->x, 4, na, &b->x, 4, nb, 4, r, pairs, max);
+}
+
+/*---- bounding volume hierarchy functions ----*/
+
+#define BVHBINS 16
+#define BVHLEAF 4
+#define BVHDEPTH 60
+#define BVHPACK 8
+
+/* bvh build scratch */
+typedef struct bvhscratch {
+  float *box;
+  float *cen;
+  int *ord;
+} bvhscratch;
+
+/** half surface area of a box */
+static float bvharea(const float *mn, const float *mx) {
+  float x = mx[0] - mn[0], y = mx[1] - mn[1], z = mx[2] - mn[2];
+  return x < 0 ? 0 : x * y + y * z + z * x;
+}
+
+/** grow box mn, mx by box b, 6 floats min then max */
+static void bvhgrow(float *mn, float *mx, const float *b) {
+  int j;
+  for (j = 0; j < 3; j++) {
+    mn[j] = b[j] < mn[j] ? b[j] : mn[j];
+    mx[j] = b[j + 3] > mx[j] ? b[j + 3] : mx[j];
+  }
+}
+
+/** reset box mn, mx to empty */
+static void bvhempty(float *mn, float *mx) {
+  int j;
+  for (j = 0; j < 3; j++) {
+    mn[j] = HUGE_VAL;
+    mx[j] = -HUGE_VAL;
+  }
+}
+
+/**
+ * bvh split.
+ * bounds the triangles of ord[first, first + count) into node ni
+ * and either keeps them as a leaf or bins their centroids on
+ * each axis, picks the cheapest of the BVHBINS - 1 planes by
+ * surface area heuristic and recurses into two adjacent nodes.
+ */
+static void bvhsplit(bvh *b, bvhscratch *s, int ni, int first,
+                     int count, int depth) {
+  bvhnode *n = &b->node[ni];
+  float cmn[3], cmx[3], bmn[BVHBINS][3], bmx[BVHBINS][3];
+  float lmn[3], lmx[3], rarea[BVHBINS];
+  int bcnt[BVHBINS];
+  float k, c, cost, best = HUGE_VAL;
+  int i, j, axis, bin, nl, split = -1, baxis = 0;
+  const float *cp;
+  bvhempty(n->min, n->max);
+  bvhempty(cmn, cmx);
+  for (i = first; i < first + count; i++) {
+    bvhgrow(n->min, n->max, s->box + 6 * s->ord[i]);
+    cp = s->cen + 3 * s->ord[i];
+    for (j = 0; j < 3; j++) {
+      cmn[j] = cp[j] < cmn[j] ? cp[j] : cmn[j];
+      cmx[j] = cp[j] > cmx[j] ? cp[j] : cmx[j];
+    }
+  }
+  n->left = first;
+  n->count = count;
+  if (count <= 2 || depth >= BVHDEPTH)
+    return;
+  for (axis = 0; axis < 3; axis++) {
+    if (cmx[axis] <= cmn[axis])
+      continue;
+    k = BVHBINS / (cmx[axis] - cmn[axis]);
+    for (bin = 0; bin < BVHBINS; bin++) {
+      bcnt[bin] = 0;
+      bvhempty(bmn[bin], bmx[bin]);
+    }
+    for (i = first; i < first + count; i++) {
+      bin = (int)((s->cen[3 * s->ord[i] + axis] - cmn[axis]) * k);
+      bin = bin < BVHBINS ? bin : BVHBINS - 1;
+      bcnt[bin]++;
+      bvhgrow(bmn[bin], bmx[bin], s->box + 6 * s->ord[i]);
+    }
+    /* right to left sweep for areas, left to right for costs */
+    bvhempty(lmn, lmx);
+    for (bin = BVHBINS - 1; bin > 0; bin--) {
+      for (j = 0; j < 3; j++) {
+        lmn[j] = bmn[bin][j] < lmn[j] ? bmn[bin][j] : lmn[j];
+        lmx[j] = bmx[bin][j] > lmx[j] ? bmx[bin][j] : lmx[j];
+      }
+      rarea[bin] = bvharea(lmn, lmx);
+    }
+    bvhempty(lmn, lmx);
+    nl = 0;
+    for (bin = 0; bin < BVHBINS - 1; bin++) {
+      for (j = 0; j < 3; j++) {
+        lmn[j] = bmn[bin][j] < lmn[j] ? bmn[bin][j] : lmn[j];
+        lmx[j] = bmx[bin][j] > lmx[j] ? bmx[bin][j] : lmx[j];
+      }
+      nl += bcnt[bin];
+      if (nl == 0 || nl == count)
+        continue;
+      cost = bvharea(lmn, lmx) * nl + rarea[bin + 1] * (count - nl);
+      if (cost < best) {
+        best = cost;
+        split = bin;
+        baxis = axis;
+      }
+    }
+  }
+  if (split < 0)
+    return;
+  /* one traversal step against testing every triangle */
+  c = bvharea(n->min, n->max);
+  if (count <= BVHLEAF * 4 && c + best >= c * count)
+    return;
+  k = BVHBINS / (cmx[baxis] - cmn[baxis]);
+  i = first;
+  j = first + count - 1;
+  while (i <= j) {
+    bin = (int)((s->cen[3 * s->ord[i] + baxis] - cmn[baxis]) * k);
+    if ((bin < BVHBINS ? bin : BVHBINS - 1) <= split) {
+      i++;
+    } else {
+      nl = s->ord[i];
+      s->ord[i] = s->ord[j];
+      s->ord[j--] = nl;
+    }
+  }
+  nl = i - first;
+  n->left = b->nnode;
+  n->count = 0;
+  b->nnode += 2;
+  bvhsplit(b, s, n->left, first, nl, depth + 1);
+  bvhsplit(b, s, b->node[ni].left + 1, first + nl, count - nl, depth + 1);
+}
+
+/**
+ * build a bvh over an indexed triangle mesh.
+ * uses a binned surface area heuristic. triangle vertices
+ * are copied in leaf order so traversal never touches
+ * the source mesh, which can be freed after.
+ *
+ * @param v array of vertices
+ * @param idx array of 3 * ntri vertex indices
+ * @param ntri number of triangles
+ * @return bvh, with NULL node if allocation fails
+ */
+bvh bvhbuild(const v3 *v, const int *idx, int ntri) {
+  bvh b;
+  bvhscratch s;
+  int i, j, t;
+  float *bp;
+  v3 p;
+  b.nnode = 0;
+  b.ntri = ntri;
+  b.mem = malloc(sizeof(bvhnode) * (2 * (ntri > 0 ? ntri : 1)) + 64);
+  b.tri = malloc(sizeof(int) * (ntri > 0 ? ntri : 1));
+  b.tv = malloc(sizeof(v3) * 3 * (ntri > 0 ? ntri : 1));
+  s.box = malloc(sizeof(float) * 6 * (ntri > 0 ? ntri : 1));
+  s.cen = malloc(sizeof(float) * 3 * (ntri > 0 ? ntri : 1));
+  s.ord = b.tri;
+  b.node = NULL;
+  if (b.mem && b.tri && b.tv && s.box && s.cen) {
+    /* nodes are 32 bytes, align them to whole cache lines */
+    b.node = (bvhnode *)(((size_t)b.mem + 63) & ~(size_t)63);
+    for (i = 0; i < ntri; i++) {
+      bp = s.box + 6 * i;
+      bvhempty(bp, bp + 3);
+      for (j = 0; j < 3; j++) {
+        p = v[idx[3 * i + j]];
+        bp[0] = p.x < bp[0] ? p.x : bp[0];
+        bp[1] = p.y < bp[1] ? p.y : bp[1];
+        bp[2] = p.z < bp[2] ? p.z : bp[2];
+        bp[3] = p.x > bp[3] ? p.x : bp[3];
+        bp[4] = p.y > bp[4] ? p.y : bp[4];
+        bp[5] = p.z > bp[5] ? p.z : bp[5];
+      }
+      for (j = 0; j < 3; j++)
+        s.cen[3 * i + j] = 0.5f * (bp[j] + bp[j + 3]);
+      b.tri[i] = i;
+    }
+    b.nnode = ntri > 0;
+    if (ntri > 0)
+      bvhsplit(&b, &s, 0, 0, ntri, 0);
+    for (i = 0; i < ntri; i++) {
+      t = b.tri[i];
+      for (j = 0; j < 3; j++)
+        b.tv[3 * i + j] = v[idx[3 * t + j]];
+    }
+  } else {
+    bvhfree(&b);
+  }
+  free(s.box);
+  free(s.cen);
+  return b;
+}
+
+/**
+ * free a bvh.
+ *
+ * @param b bvh
+ * @return void
+ */
+void bvhfree(bvh *b) {
+  free(b->mem);
+  free(b->tri);
+  free(b->tv);
+  b->mem = NULL;
+  b->node = NULL;
+  b->tri = NULL;
+  b->tv = NULL;
+  b->nnode = b->ntri = 0;
+}
+
+/**
+ * ray triangle kernel, fast variant.
+ * moller trumbore written without early outs, the hit mask
+ * is folded into the outputs at the end. misses get
+ * t = HUGE_VAL and u = v = 0. the bvh and rayxtrin and
+ * raynxtri all use it, so they accept the same hits.
+ */
+static float mtri(float ox, float oy, float oz, float dx, float dy, float dz,
+                  float ax, float ay, float az, float bx, float by, float bz,
+                  float cx, float cy, float cz, float tmax,
+                  float *u, float *v) {
+  float e1x = bx - ax, e1y = by - ay, e1z = bz - az;
+  float e2x = cx - ax, e2y = cy - ay, e2z = cz - az;
+  float px = dy * e2z - dz * e2y;
+  float py = dz * e2x - dx * e2z;
+  float pz = dx * e2y - dy * e2x;
+  float det = e1x * px + e1y * py + e1z * pz;
+  float inv = 1.0f / det;
+  float sx = ox - ax, sy = oy - ay, sz = oz - az;
+  float qx = sy * e1z - sz * e1y;
+  float qy = sz * e1x - sx * e1z;
+  float qz = sx * e1y - sy * e1x;
+  float bu = (sx * px + sy * py + sz * pz) * inv;
+  float bv = (dx * qx + dy * qy + dz * qz) * inv;
+  float bt = (e2x * qx + e2y * qy + e2z * qz) * inv;
+  int ok = (det > 1e-12f || det < -1e-12f) &&
+           bu >= 0 && bv >= 0 && bu + bv <= 1 &&
+           bt > 0 && bt < tmax;
+  *u = ok ? bu : 0;
+  *v = ok ? bv : 0;
+  return ok ? bt : HUGE_VAL;
+}
+
+/**
+ * ray box slab test.
+ * entry distance of the ray into node n, or HUGE_VAL
+ * if it misses or enters beyond tmax.
+ */
+static float rayxnode(const bvhnode *n, const float *o,
+                      const float *inv, float tmax) {
+  float tn = 0, tf = tmax, t0, t1, f;
+  int j;
+  for (j = 0; j < 3; j++) {
+    t0 = (n->min[j] - o[j]) * inv[j];
+    t1 = (n->max[j] - o[j]) * inv[j];
+    if (t0 > t1) {
+      f = t0;
+      t0 = t1;
+      t1 = f;
+    }
+    tn = t0 > tn ? t0 : tn;
+    tf = t1 < tf ? t1 : tf;
+  }
+  return tn <= tf ? tn : HUGE_VAL;
+}
+
+/**
+ * single ray traversal.
+ * front to back with an explicit stack, stops at the
+ * first hit when any is set.
+ */
+static int bvhtrace(const bvh *b, ray r, hit *h, int any) {
+  int stack[BVHDEPTH + 4];
+  int sp = 0, ni = 0, i, l, found = 0;
+  float o[3], d[3], inv[3], t, u, v, tl, tr;
+  const bvhnode *n;
+  const v3 *tv;
+  o[0] = r.o.x; o[1] = r.o.y; o[2] = r.o.z;
+  d[0] = r.d.x; d[1] = r.d.y; d[2] = r.d.z;
+  for (i = 0; i < 3; i++)
+    inv[i] = 1.0f / d[i];
+  h->t = r.tmax;
+  h->tri = -1;
+  if (b->nnode == 0 || rayxnode(b->node, o, inv, h->t) == HUGE_VAL)
+    return 0;
+  for (;;) {
+    n = &b->node[ni];
+    if (n->count) {
+      for (i = n->left; i < n->left + n->count; i++) {
+        tv = b->tv + 3 * i;
+        t = mtri(o[0], o[1], o[2], d[0], d[1], d[2], tv[0].x, tv[0].y,
+                 tv[0].z, tv[1].x, tv[1].y, tv[1].z, tv[2].x, tv[2].y,
+                 tv[2].z, h->t, &u, &v);
+        if (t < h->t) {
+          h->t = t;
+          h->u = u;
+          h->v = v;
+          h->tri = b->tri[i];
+          found = 1;
+          if (any)
+            return 1;
+        }
+      }
+    } else {
+      l = n->left;
+      tl = rayxnode(&b->node[l], o, inv, h->t);
+      tr = rayxnode(&b->node[l + 1], o, inv, h->t);
+      if (tl != HUGE_VAL || tr != HUGE_VAL) {
+        if (tl <= tr) {
+          if (tr != HUGE_VAL)
+            stack[sp++] = l + 1;
+          ni = l;
+        } else {
+          if (tl != HUGE_VAL)
+            stack[sp++] = l;
+          ni = l + 1;
+        }
+        continue;
+      }
+    }
+    if (sp == 0)
+      return found;
+    ni = stack[--sp];
+  }
+}
+
+/**
+ * bvh closest hit.
+ *
+ * @param b bvh
+ * @param r ray, hits are searched in (0, r.tmax)
+ * @param h hit out, h->tri is -1 on a miss
+ * @return 1 if the ray hit a triangle
+ */
+int bvhhit(const bvh *b, ray r, hit *h) {
+  return bvhtrace(b, r, h, 0);
+}
+
+/**
+ * bvh any hit.
+ * for shadow and visibility rays, stops at the first hit.
+ *
+ * @param b bvh
+ * @param r ray, hits are searched in (0, r.tmax)
+ * @return 1 if anything blocks the ray
+ */
+int bvhany(const bvh *b, ray r) {
+  hit h;
+  return bvhtrace(b, r, &h, 1);
+}
+
+/*
+ * rayxnodep is the packet slab test: the nearest entry of the
+ * rays of a packet into node n. lanes are kept in split arrays,
+ * lim[j] is the current hit distance of a live ray and -1 for
+ * a dead or unused one, so those never enter.
+ */
+#if defined(__AVX__)
+
+/** 8 rays per step in avx */
+static float rayxnodep(const bvhnode *n, float o[3][BVHPACK],
+                       float inv[3][BVHPACK], const float *lim) {
+  __m256 tn = _mm256_setzero_ps(), tf = _mm256_loadu_ps(lim), t0, t1;
+  __m128 m;
+  int c;
+  for (c = 0; c < 3; c++) {
+    t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(n->min[c]),
+                                     _mm256_loadu_ps(o[c])),
+                       _mm256_loadu_ps(inv[c]));
+    t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(n->max[c]),
+                                     _mm256_loadu_ps(o[c])),
+                       _mm256_loadu_ps(inv[c]));
+    tn = _mm256_max_ps(_mm256_min_ps(t0, t1), tn);
+    tf = _mm256_min_ps(_mm256_max_ps(t1, t0), tf);
+  }
+  tn = _mm256_blendv_ps(_mm256_set1_ps(HUGE_VAL), tn,
+                        _mm256_cmp_ps(tn, tf, _CMP_LE_OQ));
+  m = _mm_min_ps(_mm256_castps256_ps128(tn), _mm256_extractf128_ps(tn, 1));
+  m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+  m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+  return _mm_cvtss_f32(m);
+}
+
+#elif defined(__SSE2__)
+
+/** 4 rays per step in sse2 */
+static float rayxnodep(const bvhnode *n, float o[3][BVHPACK],
+                       float inv[3][BVHPACK], const float *lim) {
+  __m128 best = _mm_set1_ps(HUGE_VAL), tn, tf, t0, t1, in;
+  int c, j;
+  for (j = 0; j < BVHPACK; j += 4) {
+    tn = _mm_setzero_ps();
+    tf = _mm_loadu_ps(lim + j);
+    for (c = 0; c < 3; c++) {
+      t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(n->min[c]),
+                                 _mm_loadu_ps(o[c] + j)),
+                      _mm_loadu_ps(inv[c] + j));
+      t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(n->max[c]),
+                                 _mm_loadu_ps(o[c] + j)),
+                      _mm_loadu_ps(inv[c] + j));
+      tn = _mm_max_ps(_mm_min_ps(t0, t1), tn);
+      tf = _mm_min_ps(_mm_max_ps(t1, t0), tf);
+    }
+    in = _mm_cmple_ps(tn, tf);
+    tn = _mm_or_ps(_mm_and_ps(in, tn),
+                   _mm_andnot_ps(in, _mm_set1_ps(HUGE_VAL)));
+    best = _mm_min_ps(best, tn);
+  }
+  best = _mm_min_ps(best, _mm_movehl_ps(best, best));
+  best = _mm_min_ss(best, _mm_shuffle_ps(best, best, 1));
+  return _mm_cvtss_f32(best);
+}
+
+#else
+
+/** BVHPACK rays per step in plain c */
+static float rayxnodep(const bvhnode *n, float o[3][BVHPACK],
+                       float inv[3][BVHPACK], const float *lim) {
+  float tn, tf, t0, t1, f, best = HUGE_VAL;
+  int j, c;
+  for (j = 0; j < BVHPACK; j++) {
+    tn = 0;
+    tf = lim[j];
+    for (c = 0; c < 3; c++) {
+      t0 = (n->min[c] - o[c][j]) * inv[c][j];
+      t1 = (n->max[c] - o[c][j]) * inv[c][j];
+      f = t0 < t1 ? t0 : t1;
+      t1 = t0 < t1 ? t1 : t0;
+      tn = f > tn ? f : tn;
+      tf = t1 < tf ? t1 : tf;
+    }
+    if (tn <= tf && tn < best)
+      best = tn;
+  }
+  return best;
+}
+
+#endif
+
+/**
+ * packet traversal.
+ * up to BVHPACK rays walk the tree together, a node is
+ * entered if any live ray enters it closer than its
+ * current hit, and each leaf is tested against every ray.
+ */
+static int bvhtracep(const bvh *b, const ray *r, hit *h, int m, int any) {
+  int stack[BVHDEPTH + 4];
+  float o[3][BVHPACK], d[3][BVHPACK], inv[3][BVHPACK], lim[BVHPACK];
+  float tl, tr, t, u, v;
+  int live[BVHPACK];
+  int sp = 0, ni = 0, i, j, l, nlive = m, found = 0;
+  const bvhnode *n;
+  const v3 *tv;
+  for (j = 0; j < m; j++) {
+    o[0][j] = r[j].o.x; o[1][j] = r[j].o.y; o[2][j] = r[j].o.z;
+    d[0][j] = r[j].d.x; d[1][j] = r[j].d.y; d[2][j] = r[j].d.z;
+    for (i = 0; i < 3; i++)
+      inv[i][j] = 1.0f / d[i][j];
+    h[j].t = lim[j] = r[j].tmax;
+    h[j].tri = -1;
+    live[j] = 1;
+  }
+  /* unused lanes of a short packet never enter a node */
+  for (; j < BVHPACK; j++) {
+    for (i = 0; i < 3; i++)
+      o[i][j] = inv[i][j] = 0;
+    lim[j] = -1;
+  }
+  if (b->nnode == 0)
+    return 0;
+  for (;;) {
+    n = &b->node[ni];
+    if (n->count) {
+      for (i = n->left; i < n->left + n->count; i++)
+        for (j = 0; j < m; j++) {
+          if (!live[j])
+            continue;
+          tv = b->tv + 3 * i;
+          t = mtri(o[0][j], o[1][j], o[2][j], d[0][j], d[1][j], d[2][j],
+                   tv[0].x, tv[0].y, tv[0].z, tv[1].x, tv[1].y, tv[1].z,
+                   tv[2].x, tv[2].y, tv[2].z, h[j].t, &u, &v);
+          if (t < h[j].t) {
+            if (h[j].tri < 0)
+              found++;
+            h[j].t = lim[j] = t;
+            h[j].u = u;
+            h[j].v = v;
+            h[j].tri = b->tri[i];
+            if (any) {
+              live[j] = 0;
+              lim[j] = -1;
+              if (--nlive == 0)
+                return found;
+            }
+          }
+        }
+      if (sp == 0)
+        return found;
+      ni = stack[--sp];
+      continue;
+    }
+    /* nearest entry over the live rays for each child */
+    l = n->left;
+    tl = rayxnodep(&b->node[l], o, inv, lim);
+    tr = rayxnodep(&b->node[l + 1], o, inv, lim);
+    if (tl != HUGE_VAL || tr != HUGE_VAL) {
+      if (tl <= tr) {
+        if (tr != HUGE_VAL)
+          stack[sp++] = l + 1;
+        ni = l;
+      } else {
+        if (tl != HUGE_VAL)
+          stack[sp++] = l;
+        ni = l + 1;
+      }
+      continue;
+    }
+    if (sp == 0)
+      return found;
+    ni = stack[--sp];
+  }
+}
+
+/**
+ * bvh closest hit for an array of rays.
+ * rays are traced in packets of 8, coherent rays such as
+ * camera or pick rays from neighbouring pixels share
+ * most of their node visits.
+ *
+ * @param b bvh
+ * @param r array of n rays
+ * @param h array of n hits out
+ * @param n number of rays
+ * @return number of rays that hit
+ */
+int bvhhitn(const bvh *b, const ray *r, hit *h, int n) {
+  int i, cnt = 0;
+  for (i = 0; i < n; i += BVHPACK)
+    cnt += bvhtracep(b, r + i, h + i, n - i < BVHPACK ? n - i : BVHPACK, 0);
+  return cnt;
+}
+
+/**
+ * bvh any hit for an array of rays.
+ * traced in packets of 8, a packet stops once every ray
+ * in it is blocked.
+ *
+ * @param b bvh
+ * @param r array of n rays
+ * @param blocked array of n booleans out
+ * @param n number of rays
+ * @return number of blocked rays
+ */
+int bvhanyn(const bvh *b, const ray *r, int *blocked, int n) {
+  hit h[BVHPACK];
+  int i, j, m, cnt = 0;
+  for (i = 0; i < n; i += BVHPACK) {
+    m = n - i < BVHPACK ? n - i : BVHPACK;
+    cnt += bvhtracep(b, r + i, h, m, 1);
+    for (j = 0; j < m; j++)
+      blocked[i + j] = h[j].tri >= 0;
+  }
+  return cnt;
+}
+
+/*---- dynamic bounding volume hierarchy functions ----*/
+
+/* query stack, a balanced tree of any int size is well within it */
+#define DBVHSTACK 128
+
+/** smallest aabb holding a and b */
+static aabb aabbjoin(aabb a, aabb b) {
+  aabb r;
+  r.min.x = a.min.x < b.min.x ? a.min.x : b.min.x;
+  r.min.y = a.min.y < b.min.y ? a.min.y : b.min.y;
+  r.min.z = a.min.z < b.min.z ? a.min.z : b.min.z;
+  r.max.x = a.max.x > b.max.x ? a.max.x : b.max.x;
+  r.max.y = a.max.y > b.max.y ? a.max.y : b.max.y;
+  r.max.z = a.max.z > b.max.z ? a.max.z : b.max.z;
+  return r;
+}
+
+/** half surface area of an aabb */
+static float aabbarea(aabb a) {
+  float x = a.max.x - a.min.x, y = a.max.y - a.min.y, z = a.max.z - a.min.z;
+  return x * y + y * z + z * x;
+}
+
+/**
+ * aabb overlap test.
+ * touching boxes count as overlapping.
+ *
+ * @param a aabb
+ * @param b aabb
+ * @return boolean for if a and b overlap
+ */
+int aabbxaabb(aabb a, aabb b) {
+  return (
+    a.min.x <= b.max.x && b.min.x <= a.max.x &&
+    a.min.y <= b.max.y && b.min.y <= a.max.y &&
+    a.min.z <= b.max.z && b.min.z <= a.max.z
+  ) ? 1 : 0;
+}
+
+/**
+ * new dynamic bvh.
+ *
+ * @return an empty dbvh
+ */
+dbvh dbvhnew() {
+  dbvh t;
+  t.node = NULL;
+  t.cap = 0;
+  t.count = 0;
+  t.root = -1;
+  t.freelist = -1;
+  return t;
+}
+
+/**
+ * free a dynamic bvh.
+ *
+ * @param t dbvh
+ * @return void
+ */
+void dbvhfree(dbvh *t) {
+  free(t->node);
+  *t = dbvhnew();
+}
+
+/** take a node from the pool, growing it if needed */
+static int dbvhalloc(dbvh *t) {
+  int i, cap;
+  dbvhnode *n;
+  if (t->freelist < 0) {
+    cap = t->cap ? t->cap * 2 : 16;
+    n = realloc(t->node, sizeof(dbvhnode) * cap);
+    if (!n)
+      return -1;
+    t->node = n;
+    for (i = t->cap; i < cap; i++) {
+      n[i].parent = i + 1 < cap ? i + 1 : -1;
+      n[i].height = -1;
+    }
+    t->freelist = t->cap;
+    t->cap = cap;
+  }
+  i = t->freelist;
+  t->freelist = t->node[i].parent;
+  t->node[i].parent = -1;
+  t->node[i].left = -1;
+  t->node[i].right = -1;
+  t->node[i].height = 0;
+  t->count++;
+  return i;
+}
+
+/** return a node to the pool */
+static void dbvhrelease(dbvh *t, int i) {
+  t->node[i].parent = t->freelist;
+  t->node[i].height = -1;
+  t->freelist = i;
+  t->count--;
+}
+
+/** recompute height and box of interior node i from its children */
+static void dbvhfix(dbvh *t, int i) {
+  dbvhnode *n = t->node;
+  int l = n[i].left, r = n[i].right;
+  n[i].height = 1 + (n[l].height > n[r].height ? n[l].height : n[r].height);
+  n[i].box = aabbjoin(n[l].box, n[r].box);
+}
+
+/** point the parent of old, or the root, at new */
+static void dbvhrelink(dbvh *t, int parent, int old, int new) {
+  if (parent < 0)
+    t->root = new;
+  else if (t->node[parent].left == old)
+    t->node[parent].left = new;
+  else
+    t->node[parent].right = new;
+}
+
+/**
+ * dynamic bvh rotation.
+ * if the children of a differ in height by more than one,
+ * the taller child c is rotated up into a's place. of c's
+ * children the taller stays with c and the other moves
+ * under a. returns the node now at the top of the subtree.
+ */
+static int dbvhbalance(dbvh *t, int a) {
+  dbvhnode *n = t->node;
+  int b, c, f, g, bal, lean;
+  if (n[a].left < 0 || n[a].height < 2)
+    return a;
+  bal = n[n[a].right].height - n[n[a].left].height;
+  if (bal >= -1 && bal <= 1)
+    return a;
+  lean = bal > 0;
+  c = lean ? n[a].right : n[a].left;
+  b = lean ? n[a].left : n[a].right;
+  f = n[c].left;
+  g = n[c].right;
+  if (n[f].height < n[g].height) {
+    f = n[c].right;
+    g = n[c].left;
+  }
+  /* c takes a's place with children a and f, a keeps b and g */
+  n[c].parent = n[a].parent;
+  dbvhrelink(t, n[c].parent, a, c);
+  n[c].left = a;
+  n[c].right = f;
+  n[a].parent = c;
+  n[a].left = b;
+  n[a].right = g;
+  n[g].parent = a;
+  dbvhfix(t, a);
+  dbvhfix(t, c);
+  return c;
+}
+
+/** walk from i to the root refitting and rebalancing */
+static void dbvhclimb(dbvh *t, int i) {
+  while (i >= 0) {
+    i = dbvhbalance(t, i);
+    dbvhfix(t, i);
+    i = t->node[i].parent;
+  }
+}
+
+/**
+ * dynamic bvh insert.
+ * descends to the sibling that grows the total surface
+ * area least, then rotates on the way back up to keep
+ * the tree balanced.
+ *
+ * @param t dbvh
+ * @param box aabb of the object
+ * @param id user index stored in the leaf
+ * @return leaf handle, or -1 if allocation fails
+ */
+int dbvhinsert(dbvh *t, aabb box, int id) {
+  dbvhnode *n;
+  int leaf = dbvhalloc(t);
+  int i, p, l, r;
+  float area, joined, cost, inherit, cl, cr;
+  if (leaf < 0)
+    return -1;
+  n = t->node;
+  n[leaf].box = box;
+  n[leaf].id = id;
+  if (t->root < 0) {
+    t->root = leaf;
+    return leaf;
+  }
+  i = t->root;
+  while (n[i].left >= 0) {
+    l = n[i].left;
+    r = n[i].right;
+    area = aabbarea(n[i].box);
+    joined = aabbarea(aabbjoin(n[i].box, box));
+    cost = 2 * joined;
+    inherit = 2 * (joined - area);
+    cl = aabbarea(aabbjoin(n[l].box, box)) + inherit;
+    if (n[l].left >= 0)
+      cl -= aabbarea(n[l].box);
+    cr = aabbarea(aabbjoin(n[r].box, box)) + inherit;
+    if (n[r].left >= 0)
+      cr -= aabbarea(n[r].box);
+    if (cost < cl && cost < cr)
+      break;
+    i = cl < cr ? l : r;
+  }
+  p = dbvhalloc(t);
+  if (p < 0) {
+    dbvhrelease(t, leaf);
+    return -1;
+  }
+  n = t->node;
+  n[p].parent = n[i].parent;
+  dbvhrelink(t, n[p].parent, i, p);
+  n[p].left = i;
+  n[p].right = leaf;
+  n[p].id = -1;
+  n[i].parent = p;
+  n[leaf].parent = p;
+  dbvhclimb(t, p);
+  return leaf;
+}
+
+/**
+ * dynamic bvh remove.
+ *
+ * @param t dbvh
+ * @param leaf handle from dbvhinsert
+ * @return void
+ */
+void dbvhremove(dbvh *t, int leaf) {
+  dbvhnode *n = t->node;
+  int p = n[leaf].parent, s, g;
+  dbvhrelease(t, leaf);
+  if (p < 0) {
+    t->root = -1;
+    return;
+  }
+  s = n[p].left == leaf ? n[p].right : n[p].left;
+  g = n[p].parent;
+  n[s].parent = g;
+  dbvhrelink(t, g, p, s);
+  dbvhrelease(t, p);
+  dbvhclimb(t, g);
+}
+
+/** 1 if a and b are the same box */
+static int aabbeq(aabb a, aabb b) {
+  return a.min.x == b.min.x && a.min.y == b.min.y && a.min.z == b.min.z &&
+         a.max.x == b.max.x && a.max.y == b.max.y && a.max.z == b.max.z;
+}
+
+/**
+ * dynamic bvh batch refit.
+ * moves n leaves to new boxes then walks up from each,
+ * refitting parents until a box comes out unchanged, so
+ * the cost follows the moved leaves times the depth and
+ * shared ancestors are mostly refit once. the topology is
+ * kept, objects that travel far should be removed and
+ * inserted again now and then to keep the tree tight.
+ *
+ * @param t dbvh
+ * @param leaf array of n leaf handles
+ * @param box array of n new aabb
+ * @param n number of moved leaves
+ * @return void
+ */
+void dbvhrefit(dbvh *t, const int *leaf, const aabb *box, int n) {
+  dbvhnode *nd = t->node;
+  aabb b;
+  int i, p;
+  for (i = 0; i < n; i++)
+    nd[leaf[i]].box = box[i];
+  for (i = 0; i < n; i++)
+    for (p = nd[leaf[i]].parent; p >= 0; p = nd[p].parent) {
+      b = aabbjoin(nd[nd[p].left].box, nd[nd[p].right].box);
+      if (aabbeq(b, nd[p].box))
+        break;
+      nd[p].box = b;
+    }
+}
+
+/** box query of the subtree at root, recursing if it outgrows the stack */
+static int dbvhfind(const dbvh *t, int root, aabb box, int *ids, int max) {
+  int stack[DBVHSTACK];
+  int sp = 0, i, cnt = 0;
+  const dbvhnode *n = t->node;
+  stack[sp++] = root;
+  while (sp > 0) {
+    i = stack[--sp];
+    if (!aabbxaabb(n[i].box, box))
+      continue;
+    if (n[i].left < 0) {
+      if (cnt < max)
+        ids[cnt] = n[i].id;
+      cnt++;
+    } else if (sp + 2 > DBVHSTACK) {
+      cnt += dbvhfind(t, i, box, cnt < max ? ids + cnt : ids,
+                      cnt < max ? max - cnt : 0);
+    } else {
+      stack[sp++] = n[i].left;
+      stack[sp++] = n[i].right;
+    }
+  }
+  return cnt;
+}
+
+/**
+ * dynamic bvh box query.
+ *
+ * @param t dbvh
+ * @param box aabb to test
+ * @param ids array of max user ids out
+ * @param max capacity of ids
+ * @return number of leaves overlapping box, may exceed max
+ */
+int dbvhquery(const dbvh *t, aabb box, int *ids, int max) {
+  return t->root < 0 ? 0 : dbvhfind(t, t->root, box, ids, max);
+}
+
+/* overlap pair state */
+typedef struct dbvhpq {
+  const dbvhnode *n;
+  int *pairs;
+  int cnt, max;
+} dbvhpq;
+
+/** overlapping leaves between subtrees a and b */
+static void dbvhcross(dbvhpq *q, int a, int b) {
+  const dbvhnode *n = q->n;
+  if (!aabbxaabb(n[a].box, n[b].box))
+    return;
+  if (n[a].left < 0 && n[b].left < 0) {
+    if (q->cnt < q->max) {
+      q->pairs[2 * q->cnt] = n[a].id;
+      q->pairs[2 * q->cnt + 1] = n[b].id;
+    }
+    q->cnt++;
+  } else if (n[b].left < 0 ||
+             (n[a].left >= 0 && n[a].height >= n[b].height)) {
+    dbvhcross(q, n[a].left, b);
+    dbvhcross(q, n[a].right, b);
+  } else {
+    dbvhcross(q, a, n[b].left);
+    dbvhcross(q, a, n[b].right);
+  }
+}
+
+/** overlapping leaves within subtree i */
+static void dbvhself(dbvhpq *q, int i) {
+  if (q->n[i].left < 0)
+    return;
+  dbvhcross(q, q->n[i].left, q->n[i].right);
+  dbvhself(q, q->n[i].left);
+  dbvhself(q, q->n[i].right);
+}
+
+/**
+ * dynamic bvh overlap pairs.
+ * descends the tree against itself, so subtrees whose
+ * boxes do not touch are skipped together.
+ *
+ * @param t dbvh
+ * @param pairs array of 2 * max user ids out
+ * @param max capacity of pairs in pairs
+ * @return number of overlapping pairs, may exceed max
+ */
+int dbvhpairs(const dbvh *t, int *pairs, int max) {
+  dbvhpq q;
+  q.n = t->node;
+  q.pairs = pairs;
+  q.cnt = 0;
+  q.max = max;
+  if (t->root >= 0)
+    dbvhself(&q, t->root);
+  return q.cnt;
+}
+
+/*---- ray intersection kernels ----*/
+
+/* watertight ray setup, see wtri */
+typedef struct wray {
+  int kx, ky, kz;
+  float sx, sy, sz;
+  float o[3];
+} wray;
+
+/**
+ * watertight ray setup.
+ * picks the dominant axis of d as z and builds the shear
+ * that maps the ray onto it.
+ */
+static wray wsetup(float ox, float oy, float oz, float dx, float dy, float dz) {
+  wray w;
+  float d[3];
+  int k;
+  d[0] = dx;
+  d[1] = dy;
+  d[2] = dz;
+  w.kz = fabs(dx) > fabs(dy) ? (fabs(dx) > fabs(dz) ? 0 : 2)
+                             : (fabs(dy) > fabs(dz) ? 1 : 2);
+  w.kx = (w.kz + 1) % 3;
+  w.ky = (w.kx + 1) % 3;
+  if (d[w.kz] < 0) {
+    k = w.kx;
+    w.kx = w.ky;
+    w.ky = k;
+  }
+  w.sx = d[w.kx] / d[w.kz];
+  w.sy = d[w.ky] / d[w.kz];
+  w.sz = 1.0f / d[w.kz];
+  w.o[0] = ox;
+  w.o[1] = oy;
+  w.o[2] = oz;
+  return w;
+}
+
+/**
+ * ray triangle kernel, watertight variant.
+ * woop, benthin and wald's sheared edge tests, rays through
+ * a shared edge or vertex hit exactly one of the triangles.
+ * edge values that come out exactly zero are redone in double.
+ * misses get t = HUGE_VAL and u = v = 0.
+ */
+static float wtri(const wray *w, const float *a, const float *b,
+                  const float *c, float tmax, float *u, float *v) {
+  float ax = a[w->kx] - w->o[w->kx], ay = a[w->ky] - w->o[w->ky];
+  float az = a[w->kz] - w->o[w->kz];
+  float bx = b[w->kx] - w->o[w->kx], by = b[w->ky] - w->o[w->ky];
+  float bz = b[w->kz] - w->o[w->kz];
+  float cx = c[w->kx] - w->o[w->kx], cy = c[w->ky] - w->o[w->ky];
+  float cz = c[w->kz] - w->o[w->kz];
+  float eu, ev, ew, det, t, rdet;
+  ax -= w->sx * az;
+  ay -= w->sy * az;
+  bx -= w->sx * bz;
+  by -= w->sy * bz;
+  cx -= w->sx * cz;
+  cy -= w->sy * cz;
+  eu = cx * by - cy * bx;
+  ev = ax * cy - ay * cx;
+  ew = bx * ay - by * ax;
+  if (eu == 0 || ev == 0 || ew == 0) {
+    eu = (float)((double)cx * by - (double)cy * bx);
+    ev = (float)((double)ax * cy - (double)ay * cx);
+    ew = (float)((double)bx * ay - (double)by * ax);
+  }
+  *u = *v = 0;
+  if ((eu < 0 || ev < 0 || ew < 0) && (eu > 0 || ev > 0 || ew > 0))
+    return HUGE_VAL;
+  det = eu + ev + ew;
+  if (det == 0)
+    return HUGE_VAL;
+  t = (eu * az + ev * bz + ew * cz) * w->sz;
+  rdet = 1.0f / det;
+  t *= rdet;
+  if (t <= 0 || t >= tmax)
+    return HUGE_VAL;
+  *u = ev * rdet;
+  *v = ew * rdet;
+  return t;
+}
+
+/*
+ * mtristep runs mtri on MTLANE ray triangle pairs at once.
+ * p[k] points at argument k of mtri: the origin, direction,
+ * the three corners and tmax. where bit k of bc is set *p[k]
+ * is shared by every pair, otherwise p[k] holds MTLANE values.
+ */
+#if defined(__AVX__)
+
+#define MTLANE 8
+
+/** a1 b1 + a2 b2 + a3 b3 in avx */
+static __m256 mtdot(__m256 a1, __m256 a2, __m256 a3, __m256 b1, __m256 b2,
+                    __m256 b3) {
+  return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a1, b1),
+                                     _mm256_mul_ps(a2, b2)),
+                       _mm256_mul_ps(a3, b3));
+}
+
+/** 8 pairs per step in avx */
+static void mtristep(const float **p, unsigned bc, float *t, float *u,
+                     float *v) {
+  __m256 x[16], e1x, e1y, e1z, e2x, e2y, e2z, px, py, pz, sx, sy, sz;
+  __m256 qx, qy, qz, det, inv, bu, bv, bt, zero = _mm256_setzero_ps(), ok;
+  int k;
+  for (k = 0; k < 16; k++)
+    x[k] = bc >> k & 1 ? _mm256_set1_ps(*p[k]) : _mm256_loadu_ps(p[k]);
+  e1x = _mm256_sub_ps(x[9], x[6]);
+  e1y = _mm256_sub_ps(x[10], x[7]);
+  e1z = _mm256_sub_ps(x[11], x[8]);
+  e2x = _mm256_sub_ps(x[12], x[6]);
+  e2y = _mm256_sub_ps(x[13], x[7]);
+  e2z = _mm256_sub_ps(x[14], x[8]);
+  px = _mm256_sub_ps(_mm256_mul_ps(x[4], e2z), _mm256_mul_ps(x[5], e2y));
+  py = _mm256_sub_ps(_mm256_mul_ps(x[5], e2x), _mm256_mul_ps(x[3], e2z));
+  pz = _mm256_sub_ps(_mm256_mul_ps(x[3], e2y), _mm256_mul_ps(x[4], e2x));
+  det = mtdot(e1x, e1y, e1z, px, py, pz);
+  inv = _mm256_div_ps(_mm256_set1_ps(1), det);
+  sx = _mm256_sub_ps(x[0], x[6]);
+  sy = _mm256_sub_ps(x[1], x[7]);
+  sz = _mm256_sub_ps(x[2], x[8]);
+  qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+  qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+  qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+  bu = _mm256_mul_ps(mtdot(sx, sy, sz, px, py, pz), inv);
+  bv = _mm256_mul_ps(mtdot(x[3], x[4], x[5], qx, qy, qz), inv);
+  bt = _mm256_mul_ps(mtdot(e2x, e2y, e2z, qx, qy, qz), inv);
+  ok = _mm256_or_ps(_mm256_cmp_ps(det, _mm256_set1_ps(1e-12f), _CMP_GT_OQ),
+                    _mm256_cmp_ps(det, _mm256_set1_ps(-1e-12f), _CMP_LT_OQ));
+  ok = _mm256_and_ps(ok, _mm256_cmp_ps(bu, zero, _CMP_GE_OQ));
+  ok = _mm256_and_ps(ok, _mm256_cmp_ps(bv, zero, _CMP_GE_OQ));
+  ok = _mm256_and_ps(ok, _mm256_cmp_ps(_mm256_add_ps(bu, bv),
+                                       _mm256_set1_ps(1), _CMP_LE_OQ));
+  ok = _mm256_and_ps(ok, _mm256_cmp_ps(bt, zero, _CMP_GT_OQ));
+  ok = _mm256_and_ps(ok, _mm256_cmp_ps(bt, x[15], _CMP_LT_OQ));
+  _mm256_storeu_ps(t, _mm256_blendv_ps(_mm256_set1_ps(HUGE_VAL), bt, ok));
+  _mm256_storeu_ps(u, _mm256_and_ps(ok, bu));
+  _mm256_storeu_ps(v, _mm256_and_ps(ok, bv));
+}
+
+#elif defined(__SSE2__)
+
+#define MTLANE 4
+
+/** a1 b1 + a2 b2 + a3 b3 in sse2 */
+static __m128 mtdot(__m128 a1, __m128 a2, __m128 a3, __m128 b1, __m128 b2,
+                    __m128 b3) {
+  return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a1, b1), _mm_mul_ps(a2, b2)),
+                    _mm_mul_ps(a3, b3));
+}
+
+/** 4 pairs per step in sse2 */
+static void mtristep(const float **p, unsigned bc, float *t, float *u,
+                     float *v) {
+  __m128 x[16], e1x, e1y, e1z, e2x, e2y, e2z, px, py, pz, sx, sy, sz;
+  __m128 qx, qy, qz, det, inv, bu, bv, bt, zero = _mm_setzero_ps(), ok;
+  int k;
+  for (k = 0; k < 16; k++)
+    x[k] = bc >> k & 1 ? _mm_set1_ps(*p[k]) : _mm_loadu_ps(p[k]);
+  e1x = _mm_sub_ps(x[9], x[6]);
+  e1y = _mm_sub_ps(x[10], x[7]);
+  e1z = _mm_sub_ps(x[11], x[8]);
+  e2x = _mm_sub_ps(x[12], x[6]);
+  e2y = _mm_sub_ps(x[13], x[7]);
+  e2z = _mm_sub_ps(x[14], x[8]);
+  px = _mm_sub_ps(_mm_mul_ps(x[4], e2z), _mm_mul_ps(x[5], e2y));
+  py = _mm_sub_ps(_mm_mul_ps(x[5], e2x), _mm_mul_ps(x[3], e2z));
+  pz = _mm_sub_ps(_mm_mul_ps(x[3], e2y), _mm_mul_ps(x[4], e2x));
+  det = mtdot(e1x, e1y, e1z, px, py, pz);
+  inv = _mm_div_ps(_mm_set1_ps(1), det);
+  sx = _mm_sub_ps(x[0], x[6]);
+  sy = _mm_sub_ps(x[1], x[7]);
+  sz = _mm_sub_ps(x[2], x[8]);
+  qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+  qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+  qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+  bu = _mm_mul_ps(mtdot(sx, sy, sz, px, py, pz), inv);
+  bv = _mm_mul_ps(mtdot(x[3], x[4], x[5], qx, qy, qz), inv);
+  bt = _mm_mul_ps(mtdot(e2x, e2y, e2z, qx, qy, qz), inv);
+  ok = _mm_or_ps(_mm_cmpgt_ps(det, _mm_set1_ps(1e-12f)),
+                 _mm_cmplt_ps(det, _mm_set1_ps(-1e-12f)));
+  ok = _mm_and_ps(ok, _mm_cmpge_ps(bu, zero));
+  ok = _mm_and_ps(ok, _mm_cmpge_ps(bv, zero));
+  ok = _mm_and_ps(ok, _mm_cmple_ps(_mm_add_ps(bu, bv), _mm_set1_ps(1)));
+  ok = _mm_and_ps(ok, _mm_cmpgt_ps(bt, zero));
+  ok = _mm_and_ps(ok, _mm_cmplt_ps(bt, x[15]));
+  _mm_storeu_ps(t, _mm_or_ps(_mm_and_ps(ok, bt),
+                             _mm_andnot_ps(ok, _mm_set1_ps(HUGE_VAL))));
+  _mm_storeu_ps(u, _mm_and_ps(ok, bu));
+  _mm_storeu_ps(v, _mm_and_ps(ok, bv));
+}
+
+#else
+
+#define MTLANE 4
+
+/** MTLANE pairs per step in plain c */
+static void mtristep(const float **p, unsigned bc, float *t, float *u,
+                     float *v) {
+  float x[16];
+  int j, k;
+  for (k = 0; k < MTLANE; k++) {
+    for (j = 0; j < 16; j++)
+      x[j] = p[j][bc >> j & 1 ? 0 : k];
+    t[k] = mtri(x[0], x[1], x[2], x[3], x[4], x[5], x[6], x[7], x[8], x[9],
+                x[10], x[11], x[12], x[13], x[14], x[15], u + k, v + k);
+  }
+}
+
+#endif
+
+/**
+ * ray against many triangles.
+ * triangle i has corners a[i], b[i], c[i] in split arrays.
+ * per triangle results are written to t, u and v, any of
+ * which may be NULL. misses get t = HUGE_VAL and u = v = 0.
+ * the fast test runs 4 triangles per step with sse2 and
+ * 8 with avx.
+ *
+ * @param r ray
+ * @param a soa3 of n first corners
+ * @param b soa3 of n second corners
+ * @param c soa3 of n third corners
+ * @param n number of triangles
+ * @param t array of n hit distances out
+ * @param u array of n b weights out
+ * @param v array of n c weights out
+ * @param watertight nonzero for the watertight test
+ * @return index of the closest hit, or -1
+ */
+int rayxtrin(ray r, soa3 a, soa3 b, soa3 c, int n,
+             float *t, float *u, float *v, int watertight) {
+  wray w = wsetup(r.o.x, r.o.y, r.o.z, r.d.x, r.d.y, r.d.z);
+  float ro[7], pa[3], pb[3], pc[3], best = r.tmax;
+  float tt[MTLANE], uu[MTLANE], vv[MTLANE];
+  const float *p[16];
+  int i, k, m, hit = -1;
+  ro[0] = r.o.x; ro[1] = r.o.y; ro[2] = r.o.z;
+  ro[3] = r.d.x; ro[4] = r.d.y; ro[5] = r.d.z;
+  ro[6] = r.tmax;
+  for (k = 0; k < 6; k++)
+    p[k] = ro + k;
+  p[15] = ro + 6;
+  for (i = 0; i < n; i += MTLANE) {
+    m = n - i < MTLANE ? n - i : MTLANE;
+    if (watertight) {
+      for (k = 0; k < m; k++) {
+        pa[0] = a.x[i + k]; pa[1] = a.y[i + k]; pa[2] = a.z[i + k];
+        pb[0] = b.x[i + k]; pb[1] = b.y[i + k]; pb[2] = b.z[i + k];
+        pc[0] = c.x[i + k]; pc[1] = c.y[i + k]; pc[2] = c.z[i + k];
+        tt[k] = wtri(&w, pa, pb, pc, r.tmax, uu + k, vv + k);
+      }
+    } else if (m == MTLANE) {
+      p[6] = a.x + i; p[7] = a.y + i; p[8] = a.z + i;
+      p[9] = b.x + i; p[10] = b.y + i; p[11] = b.z + i;
+      p[12] = c.x + i; p[13] = c.y + i; p[14] = c.z + i;
+      /* the ray and tmax are shared, the corners step */
+      mtristep(p, 0x803f, tt, uu, vv);
+    } else {
+      for (k = 0; k < m; k++)
+        tt[k] = mtri(r.o.x, r.o.y, r.o.z, r.d.x, r.d.y, r.d.z,
+                     a.x[i + k], a.y[i + k], a.z[i + k], b.x[i + k],
+                     b.y[i + k], b.z[i + k], c.x[i + k], c.y[i + k],
+                     c.z[i + k], r.tmax, uu + k, vv + k);
+    }
+    for (k = 0; k < m; k++) {
+      if (t)
+        t[i + k] = tt[k];
+      if (u)
+        u[i + k] = uu[k];
+      if (v)
+        v[i + k] = vv[k];
+      if (tt[k] < best) {
+        best = tt[k];
+        hit = i + k;
+      }
+    }
+  }
+  return hit;
+}
+
+/**
+ * many rays against one triangle.
+ * ray i starts at o[i] along d[i] up to tmax[i].
+ * misses get t = HUGE_VAL and u = v = 0. the fast test
+ * runs 4 rays per step with sse2 and 8 with avx.
+ *
+ * @param o soa3 of n origins
+ * @param d soa3 of n directions
+ * @param tmax array of n maximum distances
+ * @param n number of rays
+ * @param a v3 first corner
+ * @param b v3 second corner
+ * @param c v3 third corner
+ * @param t array of n hit distances out
+ * @param u array of n b weights out
+ * @param v array of n c weights out
+ * @param watertight nonzero for the watertight test
+ * @return number of rays that hit
+ */
+int raynxtri(soa3 o, soa3 d, const float *tmax, int n, v3 a, v3 b, v3 c,
+             float *t, float *u, float *v, int watertight) {
+  float tc[9], pa[3], pb[3], pc[3];
+  const float *p[16];
+  wray w;
+  int i, k, cnt = 0;
+  pa[0] = a.x; pa[1] = a.y; pa[2] = a.z;
+  pb[0] = b.x; pb[1] = b.y; pb[2] = b.z;
+  pc[0] = c.x; pc[1] = c.y; pc[2] = c.z;
+  for (k = 0; k < 3; k++) {
+    tc[k] = pa[k];
+    tc[3 + k] = pb[k];
+    tc[6 + k] = pc[k];
+  }
+  for (k = 0; k < 9; k++)
+    p[6 + k] = tc + k;
+  i = 0;
+  if (!watertight)
+    for (; i + MTLANE <= n; i += MTLANE) {
+      p[0] = o.x + i; p[1] = o.y + i; p[2] = o.z + i;
+      p[3] = d.x + i; p[4] = d.y + i; p[5] = d.z + i;
+      p[15] = tmax + i;
+      /* the triangle is shared, the rays step */
+      mtristep(p, 0x7fc0, t + i, u + i, v + i);
+      for (k = 0; k < MTLANE; k++)
+        cnt += t[i + k] != HUGE_VAL;
+    }
+  for (; i < n; i++) {
+    if (watertight) {
+      w = wsetup(o.x[i], o.y[i], o.z[i], d.x[i], d.y[i], d.z[i]);
+      t[i] = wtri(&w, pa, pb, pc, tmax[i], u + i, v + i);
+    } else {
+      t[i] = mtri(o.x[i], o.y[i], o.z[i], d.x[i], d.y[i], d.z[i],
+                  a.x, a.y, a.z, b.x, b.y, b.z, c.x, c.y, c.z,
+                  tmax[i], u + i, v + i);
+    }
+    cnt += t[i] != HUGE_VAL;
+  }
+  return cnt;
+}
+
+/**
+ * ray against many aabbs.
+ * slab test, boxes containing the origin report t = 0.
+ *
+ * @param r ray
+ * @param mn soa3 of n box minimums
+ * @param mx soa3 of n box maximums
+ * @param n number of boxes
+ * @param t array of n entry distances out, HUGE_VAL on a miss
+ * @return number of boxes hit
+ */
+int rayxaabbn(ray r, soa3 mn, soa3 mx, int n, float *t) {
+  float ix = 1.0f / r.d.x, iy = 1.0f / r.d.y, iz = 1.0f / r.d.z;
+  float t0, t1, tn, tf, f;
+  int i, cnt = 0;
+  for (i = 0; i < n; i++) {
+    t0 = (mn.x[i] - r.o.x) * ix;
+    t1 = (mx.x[i] - r.o.x) * ix;
+    tn = t0 < t1 ? t0 : t1;
+    tf = t0 < t1 ? t1 : t0;
+    t0 = (mn.y[i] - r.o.y) * iy;
+    t1 = (mx.y[i] - r.o.y) * iy;
+    f = t0 < t1 ? t0 : t1;
+    tn = f > tn ? f : tn;
+    f = t0 < t1 ? t1 : t0;
+    tf = f < tf ? f : tf;
+    t0 = (mn.z[i] - r.o.z) * iz;
+    t1 = (mx.z[i] - r.o.z) * iz;
+    f = t0 < t1 ? t0 : t1;
+    tn = f > tn ? f : tn;
+    f = t0 < t1 ? t1 : t0;
+    tf = f < tf ? f : tf;
+    tn = tn > 0 ? tn : 0;
+    tf = tf < r.tmax ? tf : r.tmax;
+    t[i] = tn <= tf ? tn : HUGE_VAL;
+    cnt += tn <= tf;
+  }
+  return cnt;
+}
+
+/**
+ * ray against many spheres.
+ * spheres containing the origin report t = 0.
+ * the direction does not need to be unit length.
+ *
+ * @param r ray
+ * @param c soa3 of n centers
+ * @param rad array of n radii
+ * @param n number of spheres
+ * @param t array of n entry distances out, HUGE_VAL on a miss
+ * @return number of spheres hit
+ */
+int rayxsphn(ray r, soa3 c, const float *rad, int n, float *t) {
+  float dd = r.d.x * r.d.x + r.d.y * r.d.y + r.d.z * r.d.z;
+  float id = 1.0f / dd;
+  float lx, ly, lz, b, k, disc, tn, tf;
+  int i, cnt = 0;
+  for (i = 0; i < n; i++) {
+    lx = c.x[i] - r.o.x;
+    ly = c.y[i] - r.o.y;
+    lz = c.z[i] - r.o.z;
+    b = (lx * r.d.x + ly * r.d.y + lz * r.d.z) * id;
+    k = (lx * lx + ly * ly + lz * lz - rad[i] * rad[i]) * id;
+    disc = b * b - k;
+    disc = sqrtf(disc > 0 ? disc : 0);
+    tn = b - disc;
+    tf = b + disc;
+    tn = tn > 0 ? tn : 0;
+    t[i] = b * b - k >= 0 && tf >= 0 && tn < r.tmax ? tn : HUGE_VAL;
+    cnt += t[i] != HUGE_VAL;
+  }
+  return cnt;
+}
+
+/*---- sweep and prune functions ----*/
+
+/** component a of v */
+static float v3at(v3 v, int a) {
+  return a == 0 ? v.x : a == 1 ? v.y : v.z;
+}
+
+/** sift key[p] down a max heap of key[0, end) */
+static void sapsift(float *key, int *val, int p, int end) {
+  float k = key[p];
+  int v = val[p];
+  int c;
+  for (; (c = 2 * p + 1) < end; p = c) {
+    if (c + 1 < end && key[c + 1] > key[c])
+      c++;
+    if (key[c] <= k)
+      break;
+    key[p] = key[c];
+    val[p] = val[c];
+  }
+  key[p] = k;
+  val[p] = v;
+}
+
+/** heap sort keys ascending, carrying vals along */
+static void sapheap(float *key, int *val, int n) {
+  int i, v;
+  float k;
+  for (i = n / 2 - 1; i >= 0; i--)
+    sapsift(key, val, i, n);
+  for (i = n - 1; i > 0; i--) {
+    k = key[i];
+    v = val[i];
+    key[i] = key[0];
+    val[i] = val[0];
+    key[0] = k;
+    val[0] = v;
+    sapsift(key, val, 0, i);
+  }
+}
+
+/**
+ * new sweep and prune broad phase.
+ *
+ * @param axis sweep axis, 0 for x, 1 for y, 2 for z.
+ *        pick the axis the bodies are most spread along.
+ * @return empty sap
+ */
+sap sapnew(int axis) {
+  sap s;
+  s.n = 0;
+  s.cap = 0;
+  s.axis = axis;
+  s.order = NULL;
+  s.buf = NULL;
+  return s;
+}
+
+/**
+ * free a sweep and prune broad phase.
+ *
+ * @param s sap
+ * @return void
+ */
+void sapfree(sap *s) {
+  free(s->order);
+  free(s->buf);
+  *s = sapnew(s->axis);
+}
+
+/**
+ * sweep and prune core.
+ * keeps the body order from the last update and insertion
+ * sorts it on the new minimums, which is close to linear
+ * when bodies move a little each frame. the boxes are then
+ * copied in sweep order to split arrays and swept; for each
+ * body the run of later bodies starting before it ends is
+ * found first, then the other two axes are tested across
+ * the whole run in one straight loop.
+ */
+static int sapsweep(sap *s, const aabb *box, const v4 *sph, int n,
+                    int *pairs, int max) {
+  int a0 = s->axis, a1 = (s->axis + 1) % 3, a2 = (s->axis + 2) % 3;
+  int i, j, k, e, o, fresh, cnt = 0;
+  int *ip;
+  float *fp, *key, *lo0, *hi0, *lo1, *hi1, *lo2, *hi2, kv;
+  float dx, dy, dz, rr;
+  const v4 *si, *sj;
+  if (n > s->cap) {
+    ip = realloc(s->order, sizeof(int) * n);
+    if (ip)
+      s->order = ip;
+    fp = realloc(s->buf, sizeof(float) * 7 * n);
+    if (fp)
+      s->buf = fp;
+    if (!ip || !fp)
+      return -1;
+    s->cap = n;
+  }
+  /* drop removed bodies, append new ones */
+  fresh = n - s->n;
+  for (i = j = 0; i < s->n; i++)
+    if (s->order[i] < n)
+      s->order[j++] = s->order[i];
+  for (i = s->n; i < n; i++)
+    s->order[j++] = i;
+  s->n = n;
+  key = s->buf;
+  lo0 = key + n;
+  hi0 = lo0 + n;
+  lo1 = hi0 + n;
+  hi1 = lo1 + n;
+  lo2 = hi1 + n;
+  hi2 = lo2 + n;
+  for (k = 0; k < n; k++)
+    key[k] = v3at(box[s->order[k]].min, a0);
+  /* mostly new bodies have no order worth keeping */
+  if (fresh > n / 2)
+    sapheap(key, s->order, n);
+  for (k = 1; k < n; k++) {
+    kv = key[k];
+    o = s->order[k];
+    for (j = k; j > 0 && key[j - 1] > kv; j--) {
+      key[j] = key[j - 1];
+      s->order[j] = s->order[j - 1];
+    }
+    key[j] = kv;
+    s->order[j] = o;
+  }
+  for (k = 0; k < n; k++) {
+    o = s->order[k];
+    lo0[k] = key[k];
+    hi0[k] = v3at(box[o].max, a0);
+    lo1[k] = v3at(box[o].min, a1);
+    hi1[k] = v3at(box[o].max, a1);
+    lo2[k] = v3at(box[o].min, a2);
+    hi2[k] = v3at(box[o].max, a2);
+  }
+  for (k = 0; k < n; k++) {
+    for (e = k + 1; e < n && lo0[e] <= hi0[k]; e++)
+      ;
+    for (j = k + 1; j < e; j++) {
+      if (!(lo1[j] <= hi1[k] && lo1[k] <= hi1[j] &&
+            lo2[j] <= hi2[k] && lo2[k] <= hi2[j]))
+        continue;
+      if (sph) {
+        /* boxes were built from spheres, finish with the real test */
+        si = &sph[s->order[k]];
+        sj = &sph[s->order[j]];
+        dx = si->x - sj->x;
+        dy = si->y - sj->y;
+        dz = si->z - sj->z;
+        rr = si->w + sj->w;
+        if (dx * dx + dy * dy + dz * dz > rr * rr)
+          continue;
+      }
+      if (cnt < max) {
+        pairs[2 * cnt] = s->order[k];
+        pairs[2 * cnt + 1] = s->order[j];
+      }
+      cnt++;
+    }
+  }
+  return cnt;
+}
+
+/**
+ * sweep and prune update over aabbs.
+ * body i is box[i]. bodies can be added by growing n and
+ * removed from the end by shrinking it, the sorted order
+ * is kept between calls.
+ *
+ * @param s sap
+ * @param box array of n aabb
+ * @param n number of bodies
+ * @param pairs array of 2 * max body indices out
+ * @param max capacity of pairs in pairs
+ * @return number of overlapping pairs, may exceed max,
+ *         or -1 if allocation fails
+ */
+int sapupdate(sap *s, const aabb *box, int n, int *pairs, int max) {
+  return sapsweep(s, box, NULL, n, pairs, max);
+}
+
+/**
+ * sweep and prune update over spheres.
+ * sphere i is centered at sph[i].xyz with radius sph[i].w.
+ * boxes around the spheres are swept, then candidate pairs
+ * are confirmed with a squared center distance test.
+ *
+ * @param s sap
+ * @param sph array of n v4 spheres
+ * @param box array of n aabb used as scratch
+ * @param n number of bodies
+ * @param pairs array of 2 * max body indices out
+ * @param max capacity of pairs in pairs
+ * @return number of overlapping pairs, may exceed max,
+ *         or -1 if allocation fails
+ */
+int sapupdatesph(sap *s, const v4 *sph, aabb *box, int n,
+                 int *pairs, int max) {
+  int i;
+  for (i = 0; i < n; i++) {
+    box[i].min = (v3){sph[i].x - sph[i].w, sph[i].y - sph[i].w, sph[i].z - sph[i].w};
+    box[i].max = (v3){sph[i].x + sph[i].w, sph[i].y + sph[i].w, sph[i].z + sph[i].w};
+  }
+  return sapsweep(s, box, sph, n, pairs, max);
+}
+
+/*---- octree functions ----*/
+
+/**
+ * new octree.
+ * the root cube starts at min with edge size and doubles
+ * to take in points that land outside it. leaves split
+ * once they hold more than bucket points, until their
+ * edge is size / 2^depth.
+ *
+ * @param min low corner of the root cube
+ * @param size edge length of the root cube
+ * @param depth max leaf depth below the root
+ * @param bucket points a leaf holds before splitting
+ * @return empty octree
+ */
+octree octnew(v3 min, float size, int depth, int bucket) {
+  octree t = {0};
+  t.min = min;
+  t.size = size > 0 ? size : 1;
+  t.depth = depth > 0 ? depth : 0;
+  t.bucket = bucket > 0 ? bucket : 1;
+  t.node = malloc(sizeof(octnode) * 16);
+  if (t.node) {
+    t.ncap = 16;
+    t.nnode = 1;
+    t.node[0].sum = (v3){0, 0, 0};
+    t.node[0].count = 0;
+    t.node[0].child = -1;
+    t.node[0].head = -1;
+  }
+  return t;
+}
+
+/**
+ * free an octree.
+ * leaves t empty with no root.
+ *
+ * @param t octree
+ * @return void
+ */
+void octfree(octree *t) {
+  free(t->node);
+  free(t->p);
+  free(t->next);
+  t->node = NULL;
+  t->p = NULL;
+  t->next = NULL;
+  t->nnode = t->ncap = t->np = t->pcap = 0;
+}
+
+/** take eight consecutive empty leaves from the pool */
+static int octalloc(octree *t) {
+  int i, cap;
+  octnode *n;
+  if (t->nnode + 8 > t->ncap) {
+    cap = t->ncap * 2 > t->nnode + 8 ? t->ncap * 2 : t->nnode + 8;
+    n = realloc(t->node, sizeof(octnode) * cap);
+    if (!n)
+      return -1;
+    t->node = n;
+    t->ncap = cap;
+  }
+  for (i = t->nnode; i < t->nnode + 8; i++) {
+    t->node[i].sum = (v3){0, 0, 0};
+    t->node[i].count = 0;
+    t->node[i].child = -1;
+    t->node[i].head = -1;
+  }
+  t->nnode += 8;
+  return t->nnode - 8;
+}
+
+/** octant of p in the cell at mn with half edge h */
+static int octant(v3 p, v3 mn, float h) {
+  return (p.x >= mn.x + h) | (p.y >= mn.y + h) << 1 | (p.z >= mn.z + h) << 2;
+}
+
+/** low corner of octant o in the cell at mn with half edge h */
+static v3 octcorner(v3 mn, float h, int o) {
+  return (v3){mn.x + (o & 1) * h, mn.y + (o >> 1 & 1) * h, mn.z + (o >> 2 & 1) * h};
+}
+
+/** double the root cube towards p, the old root becomes a child */
+static int octgrow(octree *t, v3 p) {
+  int c, o = 0;
+  float s = t->size;
+  if ((c = octalloc(t)) < 0)
+    return 0;
+  if (p.x < t->min.x) {
+    o |= 1;
+    t->min.x -= s;
+  }
+  if (p.y < t->min.y) {
+    o |= 2;
+    t->min.y -= s;
+  }
+  if (p.z < t->min.z) {
+    o |= 4;
+    t->min.z -= s;
+  }
+  t->node[c + o] = t->node[0];
+  t->node[0].child = c;
+  t->node[0].head = -1;
+  t->size = 2 * s;
+  t->depth++;
+  return 1;
+}
+
+/** split leaf i at mn with half edge h, moving its points down */
+static int octsplit(octree *t, int i, v3 mn, float h) {
+  int c, j, nx, o;
+  octnode *n;
+  if ((c = octalloc(t)) < 0)
+    return 0;
+  n = t->node;
+  for (j = n[i].head; j >= 0; j = nx) {
+    nx = t->next[j];
+    o = c + octant(t->p[j], mn, h);
+    t->next[j] = n[o].head;
+    n[o].head = j;
+    n[o].count++;
+    n[o].sum = v3v3add(n[o].sum, t->p[j]);
+  }
+  n[i].child = c;
+  n[i].head = -1;
+  return 1;
+}
+
+/**
+ * octree streaming insertion.
+ * points are appended after those already in the tree,
+ * so point j of this batch gets index np + j. non finite
+ * points are skipped.
+ *
+ * @param t octree
+ * @param p array of n v3 points
+ * @param n number of points
+ * @return boolean for if allocation succeeded
+ */
+int octinsert(octree *t, const v3 *p, int n) {
+  int i, j, k, d, cap;
+  float h;
+  v3 q, mn, *np;
+  int *nx;
+  if (!t->node)
+    return 0;
+  if (t->np + n > t->pcap) {
+    cap = t->pcap * 2 > t->np + n ? t->pcap * 2 : t->np + n;
+    np = realloc(t->p, sizeof(v3) * cap);
+    if (np)
+      t->p = np;
+    nx = realloc(t->next, sizeof(int) * cap);
+    if (nx)
+      t->next = nx;
+    if (!np || !nx)
+      return 0;
+    t->pcap = cap;
+  }
+  for (k = 0; k < n; k++) {
+    q = p[k];
+    if (!(q.x - q.x == 0 && q.y - q.y == 0 && q.z - q.z == 0))
+      continue;
+    while (q.x < t->min.x || q.y < t->min.y || q.z < t->min.z ||
+           q.x >= t->min.x + t->size || q.y >= t->min.y + t->size ||
+           q.z >= t->min.z + t->size)
+      if (!octgrow(t, q))
+        return 0;
+    /* descend, counting the point into every cell on the way */
+    i = 0;
+    d = 0;
+    mn = t->min;
+    h = t->size * 0.5f;
+    while (t->node[i].child >= 0) {
+      t->node[i].count++;
+      t->node[i].sum = v3v3add(t->node[i].sum, q);
+      j = octant(q, mn, h);
+      mn = octcorner(mn, h, j);
+      i = t->node[i].child + j;
+      h *= 0.5f;
+      d++;
+    }
+    j = t->np++;
+    t->p[j] = q;
+    t->next[j] = t->node[i].head;
+    t->node[i].head = j;
+    t->node[i].count++;
+    t->node[i].sum = v3v3add(t->node[i].sum, q);
+    /* split full leaves, following the new point down */
+    while (t->node[i].count > t->bucket && d < t->depth) {
+      if (!octsplit(t, i, mn, h))
+        return 0;
+      j = octant(q, mn, h);
+      mn = octcorner(mn, h, j);
+      i = t->node[i].child + j;
+      h *= 0.5f;
+      d++;
+    }
+  }
+  return 1;
+}
+
+/* octree query state */
+typedef struct octq {
+  const octree *t;
+  const v4 *plane;
+  aabb box;
+  float lod;
+  v3 *out;
+  int *w;
+  int cnt, max;
+} octq;
+
+/**
+ * octree cell test.
+ * returns 0 if the cell at mn with edge s is outside the
+ * query region, 2 if it is inside and 1 if it straddles.
+ * mask holds the planes, or for boxes a single bit, the
+ * parent still straddles. tests the cell is inside are
+ * cleared from mask so children skip them.
+ */
+static int octcell(const octq *q, v3 mn, float s, int *mask) {
+  int k, in = 2;
+  v4 pl;
+  v3 mx = {mn.x + s, mn.y + s, mn.z + s};
+  if (!*mask)
+    return 2;
+  if (!q->plane) {
+    if (mx.x < q->box.min.x || mn.x > q->box.max.x ||
+        mx.y < q->box.min.y || mn.y > q->box.max.y ||
+        mx.z < q->box.min.z || mn.z > q->box.max.z)
+      return 0;
+    if (mn.x >= q->box.min.x && mx.x <= q->box.max.x &&
+        mn.y >= q->box.min.y && mx.y <= q->box.max.y &&
+        mn.z >= q->box.min.z && mx.z <= q->box.max.z)
+      *mask = 0;
+    return *mask ? 1 : 2;
+  }
+  for (k = 0; k < 6; k++) {
+    if (!(*mask >> k & 1))
+      continue;
+    pl = q->plane[k];
+    /* farthest corner along the plane normal, then nearest */
+    if (pl.x * (pl.x > 0 ? mx.x : mn.x) + pl.y * (pl.y > 0 ? mx.y : mn.y) +
+        pl.z * (pl.z > 0 ? mx.z : mn.z) + pl.w < 0)
+      return 0;
+    if (pl.x * (pl.x > 0 ? mn.x : mx.x) + pl.y * (pl.y > 0 ? mn.y : mx.y) +
+        pl.z * (pl.z > 0 ? mn.z : mx.z) + pl.w >= 0)
+      *mask &= ~(1 << k);
+    else
+      in = 1;
+  }
+  return in;
+}
+
+/** point in query region, testing only planes left in mask */
+static int octin(const octq *q, v3 p, int mask) {
+  int k;
+  if (!mask)
+    return 1;
+  if (!q->plane)
+    return p.x >= q->box.min.x && p.x <= q->box.max.x &&
+           p.y >= q->box.min.y && p.y <= q->box.max.y &&
+           p.z >= q->box.min.z && p.z <= q->box.max.z;
+  for (k = 0; k < 6; k++)
+    if (mask >> k & 1 && q->plane[k].x * p.x + q->plane[k].y * p.y +
+                         q->plane[k].z * p.z + q->plane[k].w < 0)
+      return 0;
+  return 1;
+}
+
+/** append a point of weight w to the query output */
+static void octemit(octq *q, v3 p, int w) {
+  if (q->cnt < q->max) {
+    q->out[q->cnt] = p;
+    if (q->w)
+      q->w[q->cnt] = w;
+  }
+  q->cnt++;
+}
+
+/** gather points of node i at mn with edge s */
+static void octwalk(octq *q, int i, v3 mn, float s, int mask) {
+  const octnode *n = q->t->node + i;
+  int j;
+  v3 c;
+  if (n->count == 0 || !octcell(q, mn, s, &mask))
+    return;
+  if (s <= q->lod && n->count > 1) {
+    /* the centroid lies in the cell, so only straddlers test it */
+    c = v3scl(n->sum, 1.0f / n->count);
+    if (octin(q, c, mask))
+      octemit(q, c, n->count);
+  } else if (n->child < 0) {
+    for (j = n->head; j >= 0; j = q->t->next[j])
+      if (octin(q, q->t->p[j], mask))
+        octemit(q, q->t->p[j], 1);
+  } else {
+    s *= 0.5f;
+    for (j = 0; j < 8; j++)
+      octwalk(q, n->child + j, octcorner(mn, s, j), s, mask);
+  }
+}
+
+/**
+ * octree box query.
+ * cells with edge no longer than lod are returned as the
+ * centroid of their points, weighted by the point count.
+ * a lod of 0 returns every point inside box.
+ *
+ * @param t octree
+ * @param box aabb to query
+ * @param lod cell edge at which points collapse
+ * @param out array of max v3 points out
+ * @param w array of max weights out, may be NULL
+ * @param max capacity of out and w
+ * @return number of points found, may exceed max
+ */
+int octbox(const octree *t, aabb box, float lod, v3 *out, int *w, int max) {
+  octq q = {0};
+  q.t = t;
+  q.box = box;
+  q.lod = lod;
+  q.out = out;
+  q.w = w;
+  q.max = max;
+  if (t->node)
+    octwalk(&q, 0, t->min, t->size, 1);
+  return q.cnt;
+}
+
+/**
+ * octree frustum query.
+ * a point p is inside plane v4 (a, b, c, d) when
+ * a * p.x + b * p.y + c * p.z + d >= 0, so the six
+ * planes face into the frustum. lod works as in octbox.
+ *
+ * @param t octree
+ * @param plane array of 6 v4 planes
+ * @param lod cell edge at which points collapse
+ * @param out array of max v3 points out
+ * @param w array of max weights out, may be NULL
+ * @param max capacity of out and w
+ * @return number of points found, may exceed max
+ */
+int octfrustum(const octree *t, const v4 *plane, float lod,
+               v3 *out, int *w, int max) {
+  octq q = {0};
+  q.t = t;
+  q.plane = plane;
+  q.lod = lod;
+  q.out = out;
+  q.w = w;
+  q.max = max;
+  if (t->node)
+    octwalk(&q, 0, t->min, t->size, 0x3f);
+  return q.cnt;
+}
+
+/*---- morton order functions ----*/
+
+/** spread the low 16 bits of x to the even bits */
+static unsigned mort2(unsigned x) {
+#ifdef __BMI2__
+  return _pdep_u32(x, 0x55555555u);
+#else
+  x &= 0xffffu;
+  x = (x | x << 8) & 0x00ff00ffu;
+  x = (x | x << 4) & 0x0f0f0f0fu;
+  x = (x | x << 2) & 0x33333333u;
+  return (x | x << 1) & 0x55555555u;
+#endif
+}
+
+/** spread the low 10 bits of x to every third bit */
+static unsigned mort3(unsigned x) {
+#ifdef __BMI2__
+  return _pdep_u32(x, 0x09249249u);
+#else
+  x &= 0x3ffu;
+  x = (x | x << 16) & 0x030000ffu;
+  x = (x | x << 8) & 0x0300f00fu;
+  x = (x | x << 4) & 0x030c30c3u;
+  return (x | x << 2) & 0x09249249u;
+#endif
+}
+
+/** spread the low 32 bits of x to the even bits */
+static uint64_t mort2l(uint64_t x) {
+#ifdef __BMI2__
+  return _pdep_u64(x, 0x5555555555555555ull);
+#else
+  x &= 0xffffffffull;
+  x = (x | x << 16) & 0x0000ffff0000ffffull;
+  x = (x | x << 8) & 0x00ff00ff00ff00ffull;
+  x = (x | x << 4) & 0x0f0f0f0f0f0f0f0full;
+  x = (x | x << 2) & 0x3333333333333333ull;
+  return (x | x << 1) & 0x5555555555555555ull;
+#endif
+}
+
+/** spread the low 21 bits of x to every third bit */
+static uint64_t mort3l(uint64_t x) {
+#ifdef __BMI2__
+  return _pdep_u64(x, 0x1249249249249249ull);
+#else
+  x &= 0x1fffffull;
+  x = (x | x << 32) & 0x001f00000000ffffull;
+  x = (x | x << 16) & 0x001f0000ff0000ffull;
+  x = (x | x << 8) & 0x100f00f00f00f00full;
+  x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+  return (x | x << 2) & 0x1249249249249249ull;
+#endif
+}
+
+/** scale from [mn, mx] onto [0, lim] */
+static double mscale(float mn, float mx, unsigned lim) {
+  return mx > mn ? lim / ((double)mx - mn) : 0;
+}
+
+/** quantize v onto [0, lim], clamping outliers and nan to the ends */
+static unsigned mquant(float v, float mn, double s, unsigned lim) {
+  double f = ((double)v - mn) * s;
+  if (!(f > 0))
+    return 0;
+  return f < lim ? (unsigned)f : lim;
+}
+
+/**
+ * 30 bit morton codes of 2d points.
+ * points are quantized to 15 bits per axis over
+ * the box min to max and their bits interleaved,
+ * x in the lowest bit.
+ *
+ * @param p array of n v2 points
+ * @param n number of points
+ * @param min low corner of the quantization box
+ * @param max high corner of the quantization box
+ * @param key array of n codes out
+ * @return void
+ */
+void v2morton(const v2 *p, int n, v2 min, v2 max, unsigned *key) {
+  unsigned lim = (1u << 15) - 1;
+  double sx = mscale(min.x, max.x, lim), sy = mscale(min.y, max.y, lim);
+  int i;
+  for (i = 0; i < n; i++)
+    key[i] = mort2(mquant(p[i].x, min.x, sx, lim)) |
+             mort2(mquant(p[i].y, min.y, sy, lim)) << 1;
+}
+
+/**
+ * 30 bit morton codes of 3d points.
+ * points are quantized to 10 bits per axis over
+ * the box min to max and their bits interleaved,
+ * x in the lowest bit.
+ *
+ * @param p array of n v3 points
+ * @param n number of points
+ * @param min low corner of the quantization box
+ * @param max high corner of the quantization box
+ * @param key array of n codes out
+ * @return void
+ */
+void v3morton(const v3 *p, int n, v3 min, v3 max, unsigned *key) {
+  unsigned lim = (1u << 10) - 1;
+  double sx = mscale(min.x, max.x, lim), sy = mscale(min.y, max.y, lim),
+         sz = mscale(min.z, max.z, lim);
+  int i;
+  for (i = 0; i < n; i++)
+    key[i] = mort3(mquant(p[i].x, min.x, sx, lim)) |
+             mort3(mquant(p[i].y, min.y, sy, lim)) << 1 |
+             mort3(mquant(p[i].z, min.z, sz, lim)) << 2;
+}
+
+/**
+ * 62 bit morton codes of 2d points.
+ * as v2morton with 31 bits per axis.
+ *
+ * @param p array of n v2 points
+ * @param n number of points
+ * @param min low corner of the quantization box
+ * @param max high corner of the quantization box
+ * @param key array of n codes out
+ * @return void
+ */
+void v2morton64(const v2 *p, int n, v2 min, v2 max, uint64_t *key) {
+  unsigned lim = (1u << 31) - 1;
+  double sx = mscale(min.x, max.x, lim), sy = mscale(min.y, max.y, lim);
+  int i;
+  for (i = 0; i < n; i++)
+    key[i] = mort2l(mquant(p[i].x, min.x, sx, lim)) |
+             mort2l(mquant(p[i].y, min.y, sy, lim)) << 1;
+}
+
+/**
+ * 63 bit morton codes of 3d points.
+ * as v3morton with 21 bits per axis.
+ *
+ * @param p array of n v3 points
+ * @param n number of points
+ * @param min low corner of the quantization box
+ * @param max high corner of the quantization box
+ * @param key array of n codes out
+ * @return void
+ */
+void v3morton64(const v3 *p, int n, v3 min, v3 max, uint64_t *key) {
+  unsigned lim = (1u << 21) - 1;
+  double sx = mscale(min.x, max.x, lim), sy = mscale(min.y, max.y, lim),
+         sz = mscale(min.z, max.z, lim);
+  int i;
+  for (i = 0; i < n; i++)
+    key[i] = mort3l(mquant(p[i].x, min.x, sx, lim)) |
+             mort3l(mquant(p[i].y, min.y, sy, lim)) << 1 |
+             mort3l(mquant(p[i].z, min.z, sz, lim)) << 2;
+}
+
+/**
+ * radix sort of 32 bit keys.
+ * an lsd sort on bytes, skipping bytes every key
+ * shares. the sort is stable.
+ *
+ * @param key array of n keys, sorted in place
+ * @param perm array of n indices out, perm[i] is the
+ *        original position of the i-th sorted key
+ * @param n number of keys
+ * @return boolean for if allocation succeeded
+ */
+int mortonsort(unsigned *key, int *perm, int n) {
+  unsigned cnt[4][256] = {{0}};
+  unsigned *ka = key, *kb, *kt, sum, c;
+  int *pa = perm, *pb, *pt;
+  int i, d, s;
+  for (i = 0; i < n; i++) {
+    perm[i] = i;
+    for (d = 0; d < 4; d++)
+      cnt[d][key[i] >> 8 * d & 0xff]++;
+  }
+  if (n < 2)
+    return 1;
+  kb = malloc(sizeof(unsigned) * n);
+  pb = malloc(sizeof(int) * n);
+  if (!kb || !pb) {
+    free(kb);
+    free(pb);
+    return 0;
+  }
+  for (d = 0; d < 4; d++) {
+    s = 8 * d;
+    if (cnt[d][key[0] >> s & 0xff] == (unsigned)n)
+      continue;
+    for (i = 0, sum = 0; i < 256; i++) {
+      c = cnt[d][i];
+      cnt[d][i] = sum;
+      sum += c;
+    }
+    for (i = 0; i < n; i++) {
+      c = cnt[d][ka[i] >> s & 0xff]++;
+      kb[c] = ka[i];
+      pb[c] = pa[i];
+    }
+    kt = ka, ka = kb, kb = kt;
+    pt = pa, pa = pb, pb = pt;
+  }
+  if (ka != key) {
+    for (i = 0; i < n; i++) {
+      key[i] = ka[i];
+      perm[i] = pa[i];
+    }
+    kb = ka;
+    pb = pa;
+  }
+  free(kb);
+  free(pb);
+  return 1;
+}
+
+/**
+ * radix sort of 64 bit keys.
+ * as mortonsort over eight bytes.
+ *
+ * @param key array of n keys, sorted in place
+ * @param perm array of n indices out, perm[i] is the
+ *        original position of the i-th sorted key
+ * @param n number of keys
+ * @return boolean for if allocation succeeded
+ */
+int mortonsort64(uint64_t *key, int *perm, int n) {
+  unsigned cnt[8][256] = {{0}};
+  uint64_t *ka = key, *kb, *kt;
+  unsigned sum, c;
+  int *pa = perm, *pb, *pt;
+  int i, d, s;
+  for (i = 0; i < n; i++) {
+    perm[i] = i;
+    for (d = 0; d < 8; d++)
+      cnt[d][key[i] >> 8 * d & 0xff]++;
+  }
+  if (n < 2)
+    return 1;
+  kb = malloc(sizeof(uint64_t) * n);
+  pb = malloc(sizeof(int) * n);
+  if (!kb || !pb) {
+    free(kb);
+    free(pb);
+    return 0;
+  }
+  for (d = 0; d < 8; d++) {
+    s = 8 * d;
+    if (cnt[d][key[0] >> s & 0xff] == (unsigned)n)
+      continue;
+    for (i = 0, sum = 0; i < 256; i++) {
+      c = cnt[d][i];
+      cnt[d][i] = sum;
+      sum += c;
+    }
+    for (i = 0; i < n; i++) {
+      c = cnt[d][ka[i] >> s & 0xff]++;
+      kb[c] = ka[i];
+      pb[c] = pa[i];
+    }
+    kt = ka, ka = kb, kb = kt;
+    pt = pa, pa = pb, pb = pt;
+  }
+  if (ka != key) {
+    for (i = 0; i < n; i++) {
+      key[i] = ka[i];
+      perm[i] = pa[i];
+    }
+    kb = ka;
+    pb = pa;
+  }
+  free(kb);
+  free(pb);
+  return 1;
+}
+
+/**
+ * vector 2 gather.
+ * out[i] = in[perm[i]], in and out must not overlap.
+ *
+ * @param in array of v2
+ * @param perm array of n indices into in
+ * @param n number of elements
+ * @param out array of n v2 out
+ * @return void
+ */
+void v2gather(const v2 *in, const int *perm, int n, v2 *out) {
+  int i;
+  for (i = 0; i < n; i++)
+    out[i] = in[perm[i]];
+}
+
+/**
+ * vector 3 gather.
+ * out[i] = in[perm[i]], in and out must not overlap.
+ *
+ * @param in array of v3
+ * @param perm array of n indices into in
+ * @param n number of elements
+ * @param out array of n v3 out
+ * @return void
+ */
+void v3gather(const v3 *in, const int *perm, int n, v3 *out) {
+  int i;
+  for (i = 0; i < n; i++)
+    out[i] = in[perm[i]];
+}
+
+/**
+ * vector 4 gather.
+ * out[i] = in[perm[i]], in and out must not overlap.
+ *
+ * @param in array of v4
+ * @param perm array of n indices into in
+ * @param n number of elements
+ * @param out array of n v4 out
+ * @return void
+ */
+void v4gather(const v4 *in, const int *perm, int n, v4 *out) {
+  int i;
+  for (i = 0; i < n; i++)
+    out[i] = in[perm[i]];
+}
+
+/*---- vertex weld functions ----*/
+
+/**
+ * weld cell of v along one axis.
+ * cells are 2 * tol wide, so a match within tol lies in
+ * this cell or the neighbour on the nearer side, which
+ * goes in lo and hi. with no tolerance the float bits are
+ * the cell and only exact matches are searched.
+ */
+static int weldcell(float v, float inv, int *lo, int *hi) {
+  union { float f; int i; } u;
+  double c;
+  if (inv == 0) {
+    u.f = v + 0.0f;
+    *lo = *hi = 0;
+    return u.i;
+  }
+  c = floor((double)v * inv);
+  *lo = (double)v * inv - c < 0.5 ? -1 : 0;
+  *hi = *lo + 1;
+  if (!(c > -2e9))
+    return -2000000000;
+  return c < 2e9 ? (int)c : 2000000000;
+}
+
+/** slot of cell x, y, z in the table, or the empty slot it would take */
+static int weldslot(const int *tab, int mask, int x, int y, int z) {
+  unsigned h = hgkey(x, y, z);
+  int s = (h ^ h >> 16) & mask;
+  while (tab[4 * s + 3] >= 0 &&
+         (tab[4 * s] != x || tab[4 * s + 1] != y || tab[4 * s + 2] != z))
+    s = (s + 1) & mask;
+  return s;
+}
+
+/**
+ * vertex weld.
+ * vertices are merged into an earlier unique vertex
+ * within tol, whose uv and attr, when given, are also within
+ * atol. positions are hashed into cells of an open addressing
+ * table, so each vertex searches at most eight cells. gather
+ * further attributes with vgather over uniq.
+ *
+ * @param v array of n v3 positions
+ * @param uv array of n v2 attributes, may be NULL
+ * @param attr array of n v4 attributes, may be NULL
+ * @param n number of vertices
+ * @param tol position tolerance, 0 for exact matches
+ * @param atol attribute tolerance
+ * @param out array of unique v3 positions out, may be NULL
+ * @param remap array of n indices out, unique vertex of each vertex
+ * @param uniq array of original indices out, one per unique vertex
+ * @return number of unique vertices, or -1 if allocation fails
+ */
+int v3weld(const v3 *v, const v2 *uv, const v4 *attr, int n,
+           float tol, float atol, v3 *out, int *remap, int *uniq) {
+  int cap = 1, m = 0, i, j, s, hit, x, y, z;
+  int c[3], lo[3], hi[3];
+  int *tab, *next;
+  float inv = tol > 0 ? 0.5f / tol : 0, t2 = tol * tol, a2 = atol * atol;
+  v3 d;
+  v4 e;
+  while (cap < 2 * n)
+    cap <<= 1;
+  tab = malloc(sizeof(int) * 4 * cap);
+  next = malloc(sizeof(int) * (n > 0 ? n : 1));
+  if (!tab || !next) {
+    free(tab);
+    free(next);
+    return -1;
+  }
+  for (i = 0; i < cap; i++)
+    tab[4 * i + 3] = -1;
+  for (i = 0; i < n; i++) {
+    c[0] = weldcell(v[i].x, inv, lo, hi);
+    c[1] = weldcell(v[i].y, inv, lo + 1, hi + 1);
+    c[2] = weldcell(v[i].z, inv, lo + 2, hi + 2);
+    hit = -1;
+    for (z = lo[2]; z <= hi[2] && hit < 0; z++)
+      for (y = lo[1]; y <= hi[1] && hit < 0; y++)
+        for (x = lo[0]; x <= hi[0] && hit < 0; x++) {
+          s = weldslot(tab, cap - 1, c[0] + x, c[1] + y, c[2] + z);
+          for (j = tab[4 * s + 3]; j >= 0; j = next[j]) {
+            d = v3v3sub(v[uniq[j]], v[i]);
+            if (d.x * d.x + d.y * d.y + d.z * d.z > t2)
+              continue;
+            if (uv) {
+              e.x = uv[uniq[j]].x - uv[i].x;
+              e.y = uv[uniq[j]].y - uv[i].y;
+              if (e.x * e.x + e.y * e.y > a2)
+                continue;
+            }
+            if (attr) {
+              e = v4v4sub(attr[uniq[j]], attr[i]);
+              if (e.x * e.x + e.y * e.y + e.z * e.z + e.w * e.w > a2)
+                continue;
+            }
+            hit = j;
+            break;
+          }
+        }
+    if (hit < 0) {
+      hit = m++;
+      uniq[hit] = i;
+      s = weldslot(tab, cap - 1, c[0], c[1], c[2]);
+      tab[4 * s] = c[0];
+      tab[4 * s + 1] = c[1];
+      tab[4 * s + 2] = c[2];
+      next[hit] = tab[4 * s + 3];
+      tab[4 * s + 3] = hit;
+    }
+    remap[i] = hit;
+  }
+  if (out)
+    v3gather(v, uniq, m, out);
+  free(tab);
+  free(next);
+  return m;
+}
+
+/*---- dense matrix functions ----*/
+
+#define MNKC 256
+#define MNMC 64
+#define MNNC 64
+#define MNTILE 32
+
+/**
+ * new dense matrix.
+ * elements start at zero, rows are padded to a multiple
+ * of 8 floats and storage is 32 byte aligned.
+ *
+ * @param rows number of rows
+ * @param cols number of columns
+ * @return mn, with NULL a if allocation fails
+ */
+mn mnnew(int rows, int cols) {
+  mn m;
+  m.rows = rows;
+  m.cols = cols;
+  m.stride = (cols + 7) & ~7;
+  m.mem = calloc(1, sizeof(float) * m.rows * m.stride + 32);
+  m.a = m.mem ? (float *)((char *)m.mem + (32 - (uintptr_t)m.mem % 32) % 32) : NULL;
+  return m;
+}
+
+/**
+ * free a dense matrix.
+ * views are only reset, their parent owns the storage.
+ *
+ * @param m mn
+ * @return void
+ */
+void mnfree(mn *m) {
+  free(m->mem);
+  m->mem = NULL;
+  m->a = NULL;
+  m->rows = m->cols = m->stride = 0;
+}
+
+/**
+ * dense matrix view.
+ * a block of m sharing its storage, for working on
+ * row or column ranges in place.
+ *
+ * @param m mn
+ * @param r first row
+ * @param c first column
+ * @param rows number of rows
+ * @param cols number of columns
+ * @return mn view, must not be freed
+ */
+mn mnview(mn m, int r, int c, int rows, int cols) {
+  mn v;
+  v.rows = rows;
+  v.cols = cols;
+  v.stride = m.stride;
+  v.a = m.a + r * m.stride + c;
+  v.mem = NULL;
+  return v;
+}
+
+/**
+ * dense matrix identity.
+ * sets the diagonal to one and everything else to zero.
+ *
+ * @param m mn to fill
+ * @return void
+ */
+void mnid(mn m) {
+  int i, j;
+  for (i = 0; i < m.rows; i++)
+    for (j = 0; j < m.cols; j++)
+      m.a[i * m.stride + j] = i == j;
+}
+
+/**
+ * dense matrix copy.
+ *
+ * @param a mn
+ * @param out mn the same shape as a
+ * @return boolean for if the shapes agree
+ */
+int mncopy(mn a, mn out) {
+  int i, j;
+  if (a.rows != out.rows || a.cols != out.cols)
+    return 0;
+  for (i = 0; i < a.rows; i++)
+    for (j = 0; j < a.cols; j++)
+      out.a[i * out.stride + j] = a.a[i * a.stride + j];
+  return 1;
+}
+
+/**
+ * dense matrix addition.
+ * out may be a or b.
+ *
+ * @param a mn
+ * @param b mn the same shape as a
+ * @param out mn the same shape as a
+ * @return boolean for if the shapes agree
+ */
+int mnadd(mn a, mn b, mn out) {
+  int i, j;
+  if (a.rows != b.rows || a.cols != b.cols ||
+      a.rows != out.rows || a.cols != out.cols)
+    return 0;
+  for (i = 0; i < a.rows; i++)
+    for (j = 0; j < a.cols; j++)
+      out.a[i * out.stride + j] = a.a[i * a.stride + j] + b.a[i * b.stride + j];
+  return 1;
+}
+
+/**
+ * dense matrix subtraction.
+ * out may be a or b.
+ *
+ * @param a mn
+ * @param b mn the same shape as a
+ * @param out mn the same shape as a
+ * @return boolean for if the shapes agree
+ */
+int mnsub(mn a, mn b, mn out) {
+  int i, j;
+  if (a.rows != b.rows || a.cols != b.cols ||
+      a.rows != out.rows || a.cols != out.cols)
+    return 0;
+  for (i = 0; i < a.rows; i++)
+    for (j = 0; j < a.cols; j++)
+      out.a[i * out.stride + j] = a.a[i * a.stride + j] - b.a[i * b.stride + j];
+  return 1;
+}
+
+/**
+ * dense matrix elementwise multiplication.
+ * out may be a or b.
+ *
+ * @param a mn
+ * @param b mn the same shape as a
+ * @param out mn the same shape as a
+ * @return boolean for if the shapes agree
+ */
+int mnmul(mn a, mn b, mn out) {
+  int i, j;
+  if (a.rows != b.rows || a.cols != b.cols ||
+      a.rows != out.rows || a.cols != out.cols)
+    return 0;
+  for (i = 0; i < a.rows; i++)
+    for (j = 0; j < a.cols; j++)
+      out.a[i * out.stride + j] = a.a[i * a.stride + j] * b.a[i * b.stride + j];
+  return 1;
+}
+
+/**
+ * dense matrix scale.
+ * out may be a.
+ *
+ * @param a mn
+ * @param s scale
+ * @param out mn the same shape as a
+ * @return boolean for if the shapes agree
+ */
+int mnscl(mn a, float s, mn out) {
+  int i, j;
+  if (a.rows != out.rows || a.cols != out.cols)
+    return 0;
+  for (i = 0; i < a.rows; i++)
+    for (j = 0; j < a.cols; j++)
+      out.a[i * out.stride + j] = a.a[i * a.stride + j] * s;
+  return 1;
+}
+
+/**
+ * dense matrix transpose.
+ * copies in square tiles so reads and writes both
+ * stay in cache. out must not overlap a.
+ *
+ * @param a mn
+ * @param out mn with a.cols rows and a.rows columns
+ * @return boolean for if the shapes agree
+ */
+int mntrans(mn a, mn out) {
+  int i, j, ii, jj, ie, je;
+  if (a.rows != out.cols || a.cols != out.rows)
+    return 0;
+  for (ii = 0; ii < a.rows; ii += MNTILE)
+    for (jj = 0; jj < a.cols; jj += MNTILE) {
+      ie = ii + MNTILE < a.rows ? ii + MNTILE : a.rows;
+      je = jj + MNTILE < a.cols ? jj + MNTILE : a.cols;
+      for (i = ii; i < ie; i++)
+        for (j = jj; j < je; j++)
+          out.a[j * out.stride + i] = a.a[i * a.stride + j];
+    }
+  return 1;
+}
+
+/**
+ * dot product of n floats.
+ * two 8 wide accumulators with avx, two 4 wide with sse2,
+ * otherwise four scalars.
+ */
+#if defined(__AVX__)
+static float mndot(const float *r, const float *x, int n) {
+  __m256 s0 = _mm256_setzero_ps(), s1 = s0;
+  __m128 h;
+  float s;
+  int j;
+  for (j = 0; j + 16 <= n; j += 16) {
+    s0 = _mm256_add_ps(s0, _mm256_mul_ps(_mm256_loadu_ps(r + j),
+                                         _mm256_loadu_ps(x + j)));
+    s1 = _mm256_add_ps(s1, _mm256_mul_ps(_mm256_loadu_ps(r + j + 8),
+                                         _mm256_loadu_ps(x + j + 8)));
+  }
+  s0 = _mm256_add_ps(s0, s1);
+  h = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+  h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+  s = _mm_cvtss_f32(_mm_add_ss(h, _mm_shuffle_ps(h, h, 1)));
+  for (; j < n; j++)
+    s += r[j] * x[j];
+  return s;
+}
+#elif defined(__SSE2__)
+static float mndot(const float *r, const float *x, int n) {
+  __m128 s0 = _mm_setzero_ps(), s1 = s0;
+  float s;
+  int j;
+  for (j = 0; j + 8 <= n; j += 8) {
+    s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(r + j), _mm_loadu_ps(x + j)));
+    s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(r + j + 4),
+                                   _mm_loadu_ps(x + j + 4)));
+  }
+  s0 = _mm_add_ps(s0, s1);
+  s0 = _mm_add_ps(s0, _mm_movehl_ps(s0, s0));
+  s = _mm_cvtss_f32(_mm_add_ss(s0, _mm_shuffle_ps(s0, s0, 1)));
+  for (; j < n; j++)
+    s += r[j] * x[j];
+  return s;
+}
+#else
+static float mndot(const float *r, const float *x, int n) {
+  float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  int j;
+  for (j = 0; j + 4 <= n; j += 4) {
+    s0 += r[j] * x[j];
+    s1 += r[j + 1] * x[j + 1];
+    s2 += r[j + 2] * x[j + 2];
+    s3 += r[j + 3] * x[j + 3];
+  }
+  for (; j < n; j++)
+    s0 += r[j] * x[j];
+  return (s0 + s1) + (s2 + s3);
+}
+#endif
+
+/**
+ * dense matrix vector multiplication.
+ * y = a x, y must not overlap x.
+ *
+ * @param a mn
+ * @param x array of a.cols floats
+ * @param y array of a.rows floats out
+ * @return void
+ */
+void mnxv(mn a, const float *x, float *y) {
+  int i;
+  for (i = 0; i < a.rows; i++)
+    y[i] = mndot(a.a + i * a.stride, x, a.cols);
+}
+
+/**
+ * gemm register tile.
+ * c += alpha * a b over a 4 by nr block of c with a depth
+ * of kc. b is a packed panel of kc rows of 8, zero padded
+ * past nr. with avx each row of the tile is one 8 wide
+ * accumulator, with sse2 two 4 wide ones, otherwise 32
+ * scalars.
+ */
+#if defined(__AVX__)
+static void mntile(int nr, int kc, const float *a, int sa, const float *b,
+                   float *c, int sc, float alpha) {
+  __m256 c0 = _mm256_setzero_ps(), c1 = c0, c2 = c0, c3 = c0, bk;
+  float acc[4][8];
+  int j, k;
+  for (k = 0; k < kc; k++, b += 8) {
+    bk = _mm256_loadu_ps(b);
+    c0 = _mm256_add_ps(c0, _mm256_mul_ps(_mm256_set1_ps(a[k]), bk));
+    c1 = _mm256_add_ps(c1, _mm256_mul_ps(_mm256_set1_ps(a[sa + k]), bk));
+    c2 = _mm256_add_ps(c2, _mm256_mul_ps(_mm256_set1_ps(a[2 * sa + k]), bk));
+    c3 = _mm256_add_ps(c3, _mm256_mul_ps(_mm256_set1_ps(a[3 * sa + k]), bk));
+  }
+  _mm256_storeu_ps(acc[0], c0);
+  _mm256_storeu_ps(acc[1], c1);
+  _mm256_storeu_ps(acc[2], c2);
+  _mm256_storeu_ps(acc[3], c3);
+  for (k = 0; k < 4; k++)
+    for (j = 0; j < nr; j++)
+      c[k * sc + j] += alpha * acc[k][j];
+}
+#elif defined(__SSE2__)
+static void mntile(int nr, int kc, const float *a, int sa, const float *b,
+                   float *c, int sc, float alpha) {
+  __m128 c0 = _mm_setzero_ps(), c1 = c0, c2 = c0, c3 = c0;
+  __m128 c4 = c0, c5 = c0, c6 = c0, c7 = c0, lo, hi, ak;
+  float acc[4][8];
+  int j, k;
+  for (k = 0; k < kc; k++, b += 8) {
+    lo = _mm_loadu_ps(b);
+    hi = _mm_loadu_ps(b + 4);
+    ak = _mm_set1_ps(a[k]);
+    c0 = _mm_add_ps(c0, _mm_mul_ps(ak, lo));
+    c1 = _mm_add_ps(c1, _mm_mul_ps(ak, hi));
+    ak = _mm_set1_ps(a[sa + k]);
+    c2 = _mm_add_ps(c2, _mm_mul_ps(ak, lo));
+    c3 = _mm_add_ps(c3, _mm_mul_ps(ak, hi));
+    ak = _mm_set1_ps(a[2 * sa + k]);
+    c4 = _mm_add_ps(c4, _mm_mul_ps(ak, lo));
+    c5 = _mm_add_ps(c5, _mm_mul_ps(ak, hi));
+    ak = _mm_set1_ps(a[3 * sa + k]);
+    c6 = _mm_add_ps(c6, _mm_mul_ps(ak, lo));
+    c7 = _mm_add_ps(c7, _mm_mul_ps(ak, hi));
+  }
+  _mm_storeu_ps(acc[0], c0);
+  _mm_storeu_ps(acc[0] + 4, c1);
+  _mm_storeu_ps(acc[1], c2);
+  _mm_storeu_ps(acc[1] + 4, c3);
+  _mm_storeu_ps(acc[2], c4);
+  _mm_storeu_ps(acc[2] + 4, c5);
+  _mm_storeu_ps(acc[3], c6);
+  _mm_storeu_ps(acc[3] + 4, c7);
+  for (k = 0; k < 4; k++)
+    for (j = 0; j < nr; j++)
+      c[k * sc + j] += alpha * acc[k][j];
+}
+#else
+static void mntile(int nr, int kc, const float *a, int sa, const float *b,
+                   float *c, int sc, float alpha) {
+  float acc[4][8] = {{0}};
+  float a0, a1, a2, a3;
+  int j, k;
+  for (k = 0; k < kc; k++, b += 8) {
+    a0 = a[k];
+    a1 = a[sa + k];
+    a2 = a[2 * sa + k];
+    a3 = a[3 * sa + k];
+    for (j = 0; j < 8; j++) {
+      acc[0][j] += a0 * b[j];
+      acc[1][j] += a1 * b[j];
+      acc[2][j] += a2 * b[j];
+      acc[3][j] += a3 * b[j];
+    }
+  }
+  for (k = 0; k < 4; k++)
+    for (j = 0; j < nr; j++)
+      c[k * sc + j] += alpha * acc[k][j];
+}
+#endif
+
+/** gemm edge tile of fewer than 4 rows over a packed panel */
+static void mnedge(int mr, int nr, int kc, const float *a, int sa,
+                   const float *b, float *c, int sc, float alpha) {
+  float acc[4][8] = {{0}};
+  int i, j, k;
+  for (k = 0; k < kc; k++)
+    for (i = 0; i < mr; i++)
+      for (j = 0; j < 8; j++)
+        acc[i][j] += a[i * sa + k] * b[k * 8 + j];
+  for (i = 0; i < mr; i++)
+    for (j = 0; j < nr; j++)
+      c[i * sc + j] += alpha * acc[i][j];
+}
+
+/**
+ * dense general matrix multiply.
+ * c = alpha a b + beta c. the depth is split into blocks
+ * of MNKC, columns of b into blocks of MNNC and rows of a
+ * into blocks of MNMC. each MNKC by MNNC block of b is
+ * packed once into contiguous 8 column panels, which every
+ * row block of a then reuses from cache. c must not
+ * overlap a or b, split c into row views to share the work.
+ *
+ * @param alpha scale of a b
+ * @param a mn
+ * @param b mn with a.cols rows
+ * @param beta scale of c, 0 ignores the old contents
+ * @param c mn with a.rows rows and b.cols columns
+ * @return boolean for if the shapes agree
+ */
+int mngemm(float alpha, mn a, mn b, float beta, mn c) {
+  float panel[MNKC * MNNC];
+  const float *br;
+  float *pp;
+  int i, j, k, ii, jj, kk, kc, mc, nc, nr;
+  if (a.cols != b.rows || a.rows != c.rows || b.cols != c.cols)
+    return 0;
+  for (i = 0; i < c.rows; i++)
+    for (j = 0; j < c.cols; j++)
+      c.a[i * c.stride + j] = beta == 0 ? 0 : beta * c.a[i * c.stride + j];
+  for (jj = 0; jj < b.cols; jj += MNNC) {
+    nc = b.cols - jj < MNNC ? b.cols - jj : MNNC;
+    for (kk = 0; kk < a.cols; kk += MNKC) {
+      kc = a.cols - kk < MNKC ? a.cols - kk : MNKC;
+      for (j = jj; j < jj + nc; j += 8) {
+        nr = jj + nc - j < 8 ? jj + nc - j : 8;
+        pp = panel + (j - jj) * kc;
+        for (k = 0; k < kc; k++) {
+          br = b.a + (kk + k) * b.stride + j;
+          for (i = 0; i < 8; i++)
+            pp[k * 8 + i] = i < nr ? br[i] : 0;
+        }
+      }
+      for (ii = 0; ii < a.rows; ii += MNMC) {
+        mc = a.rows - ii < MNMC ? a.rows - ii : MNMC;
+        for (j = jj; j < jj + nc; j += 8) {
+          nr = jj + nc - j < 8 ? jj + nc - j : 8;
+          pp = panel + (j - jj) * kc;
+          for (i = ii; i + 4 <= ii + mc; i += 4)
+            mntile(nr, kc, a.a + i * a.stride + kk, a.stride, pp,
+                   c.a + i * c.stride + j, c.stride, alpha);
+          if (i < ii + mc)
+            mnedge(ii + mc - i, nr, kc, a.a + i * a.stride + kk, a.stride,
+                   pp, c.a + i * c.stride + j, c.stride, alpha);
+        }
+      }
+    }
+  }
+  return 1;
+}
+
+/**
+ * dense matrix multiplication.
+ * out = a b, out must not overlap a or b.
+ *
+ * @param a mn
+ * @param b mn with a.cols rows
+ * @param out mn with a.rows rows and b.cols columns
+ * @return boolean for if the shapes agree
+ */
+int mnxmn(mn a, mn b, mn out) {
+  return mngemm(1, a, b, 0, out);
+}
+
+/*---- dense solver functions ----*/
+
+#define MNNB 32
+
+/**
+ * dense lu factorization.
+ * factors a = p l u in place with partial pivoting, l has
+ * a unit diagonal and is stored below it. columns are
+ * factored in panels of MNNB, and the trailing matrix is
+ * updated with one gemm per panel.
+ *
+ * @param a square mn, overwritten with l and u
+ * @param piv array of a.rows ints out, row i was swapped with piv[i]
+ * @return boolean for if a is square and nonsingular
+ */
+int mnlu(mn a, int *piv) {
+  int n = a.rows, s = a.stride, i, j, k, p, k0, kb;
+  float m, t, *r, *q;
+  if (a.cols != n)
+    return 0;
+  for (k0 = 0; k0 < n; k0 += MNNB) {
+    kb = n - k0 < MNNB ? n - k0 : MNNB;
+    /* unblocked panel, swapping whole rows */
+    for (k = k0; k < k0 + kb; k++) {
+      p = k;
+      for (i = k + 1; i < n; i++)
+        if (fabs(a.a[i * s + k]) > fabs(a.a[p * s + k]))
+          p = i;
+      piv[k] = p;
+      if (a.a[p * s + k] == 0)
+        return 0;
+      if (p != k)
+        for (j = 0, r = a.a + k * s, q = a.a + p * s; j < n; j++) {
+          t = r[j];
+          r[j] = q[j];
+          q[j] = t;
+        }
+      r = a.a + k * s;
+      for (i = k + 1; i < n; i++) {
+        q = a.a + i * s;
+        m = q[k] /= r[k];
+        for (j = k + 1; j < k0 + kb; j++)
+          q[j] -= m * r[j];
+      }
+    }
+    if (k0 + kb == n)
+      break;
+    /* u12 = l11^-1 a12 */
+    for (k = k0; k < k0 + kb; k++)
+      for (i = k + 1; i < k0 + kb; i++) {
+        m = a.a[i * s + k];
+        r = a.a + k * s;
+        q = a.a + i * s;
+        for (j = k0 + kb; j < n; j++)
+          q[j] -= m * r[j];
+      }
+    /* a22 -= l21 u12 */
+    mngemm(-1, mnview(a, k0 + kb, k0, n - k0 - kb, kb),
+           mnview(a, k0, k0 + kb, kb, n - k0 - kb), 1,
+           mnview(a, k0 + kb, k0 + kb, n - k0 - kb, n - k0 - kb));
+  }
+  return 1;
+}
+
+/**
+ * dense lu solve.
+ * solves a x = b for every column of b in place.
+ *
+ * @param lu mn factored by mnlu
+ * @param piv pivots from mnlu
+ * @param b mn with lu.rows rows, overwritten with x
+ * @return boolean for if the shapes agree
+ */
+int mnlusolve(mn lu, const int *piv, mn b) {
+  int n = lu.rows, i, j, k;
+  float m, t, *r, *q;
+  if (b.rows != n)
+    return 0;
+  for (k = 0; k < n; k++)
+    if (piv[k] != k)
+      for (j = 0, r = b.a + k * b.stride, q = b.a + piv[k] * b.stride;
+           j < b.cols; j++) {
+        t = r[j];
+        r[j] = q[j];
+        q[j] = t;
+      }
+  for (i = 0; i < n; i++)
+    for (k = 0, q = b.a + i * b.stride; k < i; k++) {
+      m = lu.a[i * lu.stride + k];
+      for (j = 0, r = b.a + k * b.stride; j < b.cols; j++)
+        q[j] -= m * r[j];
+    }
+  for (i = n - 1; i >= 0; i--) {
+    q = b.a + i * b.stride;
+    for (k = i + 1; k < n; k++) {
+      m = lu.a[i * lu.stride + k];
+      for (j = 0, r = b.a + k * b.stride; j < b.cols; j++)
+        q[j] -= m * r[j];
+    }
+    m = 1 / lu.a[i * lu.stride + i];
+    for (j = 0; j < b.cols; j++)
+      q[j] *= m;
+  }
+  return 1;
+}
+
+/**
+ * dense lu determinant.
+ *
+ * @param lu mn factored by mnlu
+ * @param piv pivots from mnlu
+ * @return determinant of the factored matrix
+ */
+float mnludet(mn lu, const int *piv) {
+  float d = 1;
+  int i;
+  for (i = 0; i < lu.rows; i++)
+    d *= piv[i] != i ? -lu.a[i * lu.stride + i] : lu.a[i * lu.stride + i];
+  return d;
+}
+
+/**
+ * dense lu inverse.
+ *
+ * @param lu mn factored by mnlu
+ * @param piv pivots from mnlu
+ * @param out mn the same shape as lu, must not overlap it
+ * @return boolean for if the shapes agree
+ */
+int mnluinv(mn lu, const int *piv, mn out) {
+  if (out.rows != lu.rows || out.cols != lu.cols)
+    return 0;
+  mnid(out);
+  return mnlusolve(lu, piv, out);
+}
+
+/**
+ * dense cholesky factorization.
+ * factors a = l l^T in place for symmetric positive
+ * definite a. only the lower triangle is read and
+ * written. columns are factored in panels of MNNB and
+ * the trailing triangle is updated with row dot products.
+ *
+ * @param a square mn, lower triangle overwritten with l
+ * @return boolean for if a is square and positive definite
+ */
+int mnchol(mn a) {
+  int n = a.rows, s = a.stride, i, j, p, k0, kb;
+  float d, *r, *q;
+  if (a.cols != n)
+    return 0;
+  for (k0 = 0; k0 < n; k0 += MNNB) {
+    kb = n - k0 < MNNB ? n - k0 : MNNB;
+    for (j = k0; j < k0 + kb; j++) {
+      r = a.a + j * s;
+      d = r[j];
+      for (p = k0; p < j; p++)
+        d -= r[p] * r[p];
+      if (!(d > 0))
+        return 0;
+      r[j] = d = sqrtf(d);
+      for (i = j + 1; i < n; i++) {
+        q = a.a + i * s;
+        for (p = k0; p < j; p++)
+          q[j] -= q[p] * r[p];
+        q[j] /= d;
+      }
+    }
+    for (i = k0 + kb; i < n; i++)
+      for (j = k0 + kb, q = a.a + i * s; j <= i; j++) {
+        r = a.a + j * s;
+        for (p = k0, d = 0; p < k0 + kb; p++)
+          d += q[p] * r[p];
+        q[j] -= d;
+      }
+  }
+  return 1;
+}
+
+/**
+ * dense cholesky solve.
+ * solves a x = b for every column of b in place.
+ *
+ * @param l mn factored by mnchol
+ * @param b mn with l.rows rows, overwritten with x
+ * @return boolean for if the shapes agree
+ */
+int mncholsolve(mn l, mn b) {
+  int n = l.rows, i, j, k;
+  float m, *r, *q;
+  if (b.rows != n)
+    return 0;
+  for (i = 0; i < n; i++) {
+    q = b.a + i * b.stride;
+    for (k = 0; k < i; k++) {
+      m = l.a[i * l.stride + k];
+      for (j = 0, r = b.a + k * b.stride; j < b.cols; j++)
+        q[j] -= m * r[j];
+    }
+    m = 1 / l.a[i * l.stride + i];
+    for (j = 0; j < b.cols; j++)
+      q[j] *= m;
+  }
+  for (i = n - 1; i >= 0; i--) {
+    q = b.a + i * b.stride;
+    m = 1 / l.a[i * l.stride + i];
+    for (j = 0; j < b.cols; j++)
+      q[j] *= m;
+    for (k = 0; k < i; k++) {
+      m = l.a[i * l.stride + k];
+      for (j = 0, r = b.a + k * b.stride; j < b.cols; j++)
+        r[j] -= m * q[j];
+    }
+  }
+  return 1;
+}
+
+/** apply reflector k of a factored qr to the columns of b from row k */
+static void mnreflect(mn qr, const float *tau, int k, mn b, float *work) {
+  int i, j;
+  float v, *q;
+  if (tau[k] == 0)
+    return;
+  for (j = 0; j < b.cols; j++)
+    work[j] = b.a[k * b.stride + j];
+  for (i = k + 1; i < qr.rows; i++) {
+    v = qr.a[i * qr.stride + k];
+    for (j = 0, q = b.a + i * b.stride; j < b.cols; j++)
+      work[j] += v * q[j];
+  }
+  for (j = 0; j < b.cols; j++)
+    work[j] *= tau[k];
+  for (j = 0; j < b.cols; j++)
+    b.a[k * b.stride + j] -= work[j];
+  for (i = k + 1; i < qr.rows; i++) {
+    v = qr.a[i * qr.stride + k];
+    for (j = 0, q = b.a + i * b.stride; j < b.cols; j++)
+      q[j] -= v * work[j];
+  }
+}
+
+/**
+ * dense qr factorization.
+ * householder qr of a tall matrix in place. r is stored
+ * on and above the diagonal, reflector k is
+ * i - tau[k] v v^T with v[k] = 1 and the rest of v
+ * below the diagonal of column k. reflectors are applied
+ * a row at a time so the trailing update streams rows.
+ *
+ * @param a mn with a.rows >= a.cols, overwritten with q and r
+ * @param tau array of a.cols floats out
+ * @param work array of a.cols floats of scratch
+ * @return boolean for if a is not wide
+ */
+int mnqr(mn a, float *tau, float *work) {
+  int m = a.rows, n = a.cols, s = a.stride, i, k;
+  float x, nrm, beta;
+  if (m < n)
+    return 0;
+  for (k = 0; k < n; k++) {
+    x = a.a[k * s + k];
+    for (i = k + 1, nrm = 0; i < m; i++)
+      nrm += a.a[i * s + k] * a.a[i * s + k];
+    tau[k] = 0;
+    if (nrm == 0)
+      continue;
+    beta = sqrtf(x * x + nrm);
+    if (x > 0)
+      beta = -beta;
+    tau[k] = (beta - x) / beta;
+    for (i = k + 1; i < m; i++)
+      a.a[i * s + k] /= x - beta;
+    a.a[k * s + k] = beta;
+    if (k + 1 < n)
+      mnreflect(a, tau, k, mnview(a, 0, k + 1, m, n - k - 1), work);
+  }
+  return 1;
+}
+
+/**
+ * dense qr least squares solve.
+ * minimizes |a x - b| for every column of b in place,
+ * leaving x in the first a.cols rows of b.
+ *
+ * @param qr mn factored by mnqr
+ * @param tau reflector scales from mnqr
+ * @param b mn with qr.rows rows, overwritten
+ * @param work array of b.cols floats of scratch
+ * @return boolean for if the shapes agree and r is nonsingular
+ */
+int mnqrsolve(mn qr, const float *tau, mn b, float *work) {
+  int n = qr.cols, i, j, k;
+  float m, *r, *q;
+  if (b.rows != qr.rows)
+    return 0;
+  for (k = 0; k < n; k++)
+    mnreflect(qr, tau, k, b, work);
+  for (i = n - 1; i >= 0; i--) {
+    if (qr.a[i * qr.stride + i] == 0)
+      return 0;
+    q = b.a + i * b.stride;
+    for (k = i + 1; k < n; k++) {
+      m = qr.a[i * qr.stride + k];
+      for (j = 0, r = b.a + k * b.stride; j < b.cols; j++)
+        q[j] -= m * r[j];
+    }
+    m = 1 / qr.a[i * qr.stride + i];
+    for (j = 0; j < b.cols; j++)
+      q[j] *= m;
+  }
+  return 1;
+}
+
+/*---- sparse matrix functions ----*/
+
+/**
+ * new sparse matrix from triplets.
+ * entry k adds v[k] at row ri[k], column ci[k]. duplicates
+ * are summed and columns end up sorted within each row.
+ * triplets outside the matrix are dropped.
+ *
+ * @param rows number of rows
+ * @param cols number of columns
+ * @param ri array of n row indices
+ * @param ci array of n column indices
+ * @param v array of n values
+ * @param n number of triplets
+ * @return csr, with NULL start if allocation fails
+ */
+csr csrbuild(int rows, int cols, const int *ri, const int *ci,
+             const float *v, int n) {
+  csr a;
+  int i, j, k, m, e, c, nnz;
+  float t;
+  a.rows = rows;
+  a.cols = cols;
+  a.nnz = 0;
+  a.start = calloc(rows + 1, sizeof(int));
+  a.col = malloc(sizeof(int) * (n > 0 ? n : 1));
+  a.val = malloc(sizeof(float) * (n > 0 ? n : 1));
+  if (!a.start || !a.col || !a.val) {
+    csrfree(&a);
+    return a;
+  }
+  /* counting sort on rows */
+  for (k = 0; k < n; k++)
+    if (ri[k] >= 0 && ri[k] < rows && ci[k] >= 0 && ci[k] < cols)
+      a.start[ri[k] + 1]++;
+  for (i = 0; i < rows; i++)
+    a.start[i + 1] += a.start[i];
+  for (k = 0; k < n; k++)
+    if (ri[k] >= 0 && ri[k] < rows && ci[k] >= 0 && ci[k] < cols) {
+      j = a.start[ri[k]]++;
+      a.col[j] = ci[k];
+      a.val[j] = v[k];
+    }
+  /* sort each row on columns and merge duplicates, compacting down */
+  for (i = rows; i > 0; i--)
+    a.start[i] = a.start[i - 1];
+  a.start[0] = 0;
+  for (i = 0, nnz = 0; i < rows; i++) {
+    j = a.start[i];
+    e = a.start[i + 1];
+    for (k = j + 1; k < e; k++) {
+      c = a.col[k];
+      t = a.val[k];
+      for (m = k; m > j && a.col[m - 1] > c; m--) {
+        a.col[m] = a.col[m - 1];
+        a.val[m] = a.val[m - 1];
+      }
+      a.col[m] = c;
+      a.val[m] = t;
+    }
+    a.start[i] = nnz;
+    for (k = j; k < e; k++) {
+      if (nnz > a.start[i] && a.col[nnz - 1] == a.col[k]) {
+        a.val[nnz - 1] += a.val[k];
+      } else {
+        a.col[nnz] = a.col[k];
+        a.val[nnz] = a.val[k];
+        nnz++;
+      }
+    }
+  }
+  a.start[rows] = a.nnz = nnz;
+  return a;
+}
+
+/**
+ * free a sparse matrix.
+ * views are not freed, their parent owns the storage.
+ *
+ * @param a csr
+ * @return void
+ */
+void csrfree(csr *a) {
+  free(a->start);
+  free(a->col);
+  free(a->val);
+  a->start = NULL;
+  a->col = NULL;
+  a->val = NULL;
+  a->rows = a->cols = a->nnz = 0;
+}
+
+/**
+ * sparse matrix row view.
+ * rows r0 to r1 of a sharing its storage, row i of the
+ * view is row r0 + i of a. multiply views into y + r0.
+ *
+ * @param a csr
+ * @param r0 first row
+ * @param r1 one past the last row
+ * @return csr view, must not be freed
+ */
+csr csrview(const csr *a, int r0, int r1) {
+  csr v = *a;
+  v.rows = r1 - r0;
+  v.start = a->start + r0;
+  v.nnz = a->start[r1] - a->start[r0];
+  return v;
+}
+
+/**
+ * sparse matrix row split.
+ * picks row boundaries giving each part about the same
+ * number of nonzeros, so views over the parts balance
+ * when run on separate threads.
+ *
+ * @param a csr
+ * @param parts number of parts
+ * @param first array of parts + 1 rows out, part p covers
+ *        rows first[p] to first[p + 1]
+ * @return void
+ */
+void csrsplit(const csr *a, int parts, int *first) {
+  int p, r = 0;
+  first[0] = 0;
+  for (p = 1; p < parts; p++) {
+    /* first row whose start passes this part's share */
+    while (r < a->rows &&
+           a->start[r] - a->start[0] < (double)a->nnz * p / parts)
+      r++;
+    first[p] = r;
+  }
+  first[parts] = a->rows;
+}
+
+/**
+ * sparse matrix vector multiplication.
+ * y = a x, y must not overlap x.
+ *
+ * @param a csr
+ * @param x array of a.cols floats
+ * @param y array of a.rows floats out
+ * @return void
+ */
+void csrxv(const csr *a, const float *x, float *y) {
+  const int *c = a->col;
+  const float *v = a->val;
+  int i, k, e;
+  float s0, s1;
+  for (i = 0; i < a->rows; i++) {
+    s0 = s1 = 0;
+    k = a->start[i];
+    e = a->start[i + 1];
+    for (; k + 2 <= e; k += 2) {
+      s0 += v[k] * x[c[k]];
+      s1 += v[k + 1] * x[c[k + 1]];
+    }
+    if (k < e)
+      s0 += v[k] * x[c[k]];
+    y[i] = s0 + s1;
+  }
+}
+
+/**
+ * sparse matrix vector 3 multiplication.
+ * y = a x on all three components in one pass over
+ * the matrix. y must not overlap x.
+ *
+ * @param a csr
+ * @param x array of a.cols v3
+ * @param y array of a.rows v3 out
+ * @return void
+ */
+void csrxv3(const csr *a, const v3 *x, v3 *y) {
+  const int *c = a->col;
+  const float *v = a->val;
+  int i, k, e;
+  float sx, sy, sz, w;
+  const v3 *p;
+  for (i = 0; i < a->rows; i++) {
+    sx = sy = sz = 0;
+    e = a->start[i + 1];
+    for (k = a->start[i]; k < e; k++) {
+      w = v[k];
+      p = x + c[k];
+      sx += w * p->x;
+      sy += w * p->y;
+      sz += w * p->z;
+    }
+    y[i].x = sx;
+    y[i].y = sy;
+    y[i].z = sz;
+  }
+}
+
+/*---- 3x3 decomposition functions ----*/
+
+#define M3BLOCK 8
+#define M3SWEEP 5
+
+/**
+ * batched covariance of v3 neighbourhoods.
+ * neighbourhood i is the points p[idx[k]] for k from
+ * start[i] to start[i + 1], or p[k] directly when idx is
+ * NULL. sums are taken relative to the first point so
+ * distant clouds keep their precision.
+ *
+ * @param p array of v3 points
+ * @param idx array of point indices, may be NULL
+ * @param start array of n + 1 offsets into idx
+ * @param n number of neighbourhoods
+ * @param mean array of n v3 means out, may be NULL
+ * @param cov array of n m3 covariances out
+ * @return void
+ */
+void v3cov(const v3 *p, const int *idx, const int *start, int n,
+           v3 *mean, m3 *cov) {
+  int i, k, c;
+  float xx, xy, xz, yy, yz, zz, f;
+  v3 o, d, s;
+  for (i = 0; i < n; i++) {
+    c = start[i + 1] - start[i];
+    xx = xy = xz = yy = yz = zz = 0;
+    s = (v3){0, 0, 0};
+    o = c > 0 ? p[idx ? idx[start[i]] : start[i]] : s;
+    for (k = start[i]; k < start[i + 1]; k++) {
+      d = v3v3sub(p[idx ? idx[k] : k], o);
+      s = v3v3add(s, d);
+      xx += d.x * d.x;
+      xy += d.x * d.y;
+      xz += d.x * d.z;
+      yy += d.y * d.y;
+      yz += d.y * d.z;
+      zz += d.z * d.z;
+    }
+    f = c > 0 ? 1.0f / c : 0;
+    s = v3scl(s, f);
+    if (mean)
+      mean[i] = v3v3add(o, s);
+    cov[i].m[0][0] = xx * f - s.x * s.x;
+    cov[i].m[0][1] = cov[i].m[1][0] = xy * f - s.x * s.y;
+    cov[i].m[0][2] = cov[i].m[2][0] = xz * f - s.x * s.z;
+    cov[i].m[1][1] = yy * f - s.y * s.y;
+    cov[i].m[1][2] = cov[i].m[2][1] = yz * f - s.y * s.z;
+    cov[i].m[2][2] = zz * f - s.z * s.z;
+  }
+}
+
+/*
+ * m3rot is one jacobi rotation across a block: it zeroes
+ * apq in every matrix, with arp and arq the entries shared
+ * with the third row and v the eigenvector matrix. the
+ * angle is zero where apq already is.
+ */
+#if defined(__AVX__)
+
+/** x, y = c x - s y, s x + c y over one avx step */
+static void m3turn(float *x, float *y, __m256 c, __m256 s) {
+  __m256 a = _mm256_loadu_ps(x), b = _mm256_loadu_ps(y);
+  _mm256_storeu_ps(x, _mm256_sub_ps(_mm256_mul_ps(c, a), _mm256_mul_ps(s, b)));
+  _mm256_storeu_ps(y, _mm256_add_ps(_mm256_mul_ps(s, a), _mm256_mul_ps(c, b)));
+}
+
+/** 8 matrices per step in avx */
+static void m3rot(float *app, float *aqq, float *apq, float *arp, float *arq,
+                  float v[9][M3BLOCK], int p, int q) {
+  __m256 one = _mm256_set1_ps(1), zero = _mm256_setzero_ps();
+  __m256 a = _mm256_loadu_ps(apq), nz, th, sg, t, c, s;
+  int k;
+  nz = _mm256_cmp_ps(a, zero, _CMP_NEQ_UQ);
+  th = _mm256_sub_ps(_mm256_loadu_ps(aqq), _mm256_loadu_ps(app));
+  th = _mm256_div_ps(th, _mm256_mul_ps(_mm256_set1_ps(2),
+                                       _mm256_blendv_ps(one, a, nz)));
+  sg = _mm256_blendv_ps(_mm256_set1_ps(-1), one,
+                        _mm256_cmp_ps(th, zero, _CMP_GE_OQ));
+  t = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(th, th), one));
+  t = _mm256_div_ps(sg, _mm256_add_ps(_mm256_mul_ps(sg, th), t));
+  t = _mm256_and_ps(nz, t);
+  c = _mm256_div_ps(one, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(t, t),
+                                                      one)));
+  s = _mm256_mul_ps(t, c);
+  a = _mm256_mul_ps(t, a);
+  _mm256_storeu_ps(app, _mm256_sub_ps(_mm256_loadu_ps(app), a));
+  _mm256_storeu_ps(aqq, _mm256_add_ps(_mm256_loadu_ps(aqq), a));
+  _mm256_storeu_ps(apq, zero);
+  m3turn(arp, arq, c, s);
+  for (k = 0; k < 9; k += 3)
+    m3turn(v[k + p], v[k + q], c, s);
+}
+
+#elif defined(__SSE2__)
+
+/** x, y = c x - s y, s x + c y over one sse2 step */
+static void m3turn(float *x, float *y, __m128 c, __m128 s) {
+  __m128 a = _mm_loadu_ps(x), b = _mm_loadu_ps(y);
+  _mm_storeu_ps(x, _mm_sub_ps(_mm_mul_ps(c, a), _mm_mul_ps(s, b)));
+  _mm_storeu_ps(y, _mm_add_ps(_mm_mul_ps(s, a), _mm_mul_ps(c, b)));
+}
+
+/** 4 matrices per step in sse2 */
+static void m3rot(float *app, float *aqq, float *apq, float *arp, float *arq,
+                  float v[9][M3BLOCK], int p, int q) {
+  __m128 one = _mm_set1_ps(1), zero = _mm_setzero_ps();
+  __m128 a, nz, ge, th, sg, t, c, s;
+  int l, k;
+  for (l = 0; l < M3BLOCK; l += 4) {
+    a = _mm_loadu_ps(apq + l);
+    nz = _mm_cmpneq_ps(a, zero);
+    th = _mm_sub_ps(_mm_loadu_ps(aqq + l), _mm_loadu_ps(app + l));
+    th = _mm_div_ps(th, _mm_mul_ps(_mm_set1_ps(2),
+                                   _mm_or_ps(_mm_and_ps(nz, a),
+                                             _mm_andnot_ps(nz, one))));
+    ge = _mm_cmpge_ps(th, zero);
+    sg = _mm_or_ps(_mm_and_ps(ge, one), _mm_andnot_ps(ge, _mm_set1_ps(-1)));
+    t = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(th, th), one));
+    t = _mm_div_ps(sg, _mm_add_ps(_mm_mul_ps(sg, th), t));
+    t = _mm_and_ps(nz, t);
+    c = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(t, t), one)));
+    s = _mm_mul_ps(t, c);
+    a = _mm_mul_ps(t, a);
+    _mm_storeu_ps(app + l, _mm_sub_ps(_mm_loadu_ps(app + l), a));
+    _mm_storeu_ps(aqq + l, _mm_add_ps(_mm_loadu_ps(aqq + l), a));
+    _mm_storeu_ps(apq + l, zero);
+    m3turn(arp + l, arq + l, c, s);
+    for (k = 0; k < 9; k += 3)
+      m3turn(v[k + p] + l, v[k + q] + l, c, s);
+  }
+}
+
+#else
+
+/** M3BLOCK matrices per step in plain c */
+static void m3rot(float *app, float *aqq, float *apq, float *arp, float *arq,
+                  float v[9][M3BLOCK], int p, int q) {
+  int l, k;
+  float th, sg, t, c, s, x, y;
+  for (l = 0; l < M3BLOCK; l++) {
+    th = (aqq[l] - app[l]) / (2 * (apq[l] != 0 ? apq[l] : 1));
+    sg = th >= 0 ? 1 : -1;
+    t = apq[l] != 0 ? sg / (sg * th + sqrtf(th * th + 1)) : 0;
+    c = 1 / sqrtf(t * t + 1);
+    s = t * c;
+    app[l] -= t * apq[l];
+    aqq[l] += t * apq[l];
+    apq[l] = 0;
+    x = arp[l];
+    y = arq[l];
+    arp[l] = c * x - s * y;
+    arq[l] = s * x + c * y;
+    for (k = 0; k < 9; k += 3) {
+      x = v[k + p][l];
+      y = v[k + q][l];
+      v[k + p][l] = c * x - s * y;
+      v[k + q][l] = s * x + c * y;
+    }
+  }
+}
+
+#endif
+
+/**
+ * eigen decomposition of up to M3BLOCK symmetric matrices.
+ * matrices sit side by side, upper triangle as a[0..5] =
+ * 00, 01, 02, 11, 12, 22, and every one runs the same
+ * M3SWEEP cyclic sweeps. values come out ascending with
+ * eigenvectors in the rows of vec.
+ */
+static void m3eigblock(const m3 *m, int cnt, v3 *val, m3 *vec) {
+  float a[6][M3BLOCK], v[9][M3BLOCK], d[3];
+  int l, i, j, k, o[3];
+  for (l = 0; l < M3BLOCK; l++) {
+    k = l < cnt ? l : 0;
+    a[0][l] = m[k].m[0][0];
+    a[1][l] = m[k].m[0][1];
+    a[2][l] = m[k].m[0][2];
+    a[3][l] = m[k].m[1][1];
+    a[4][l] = m[k].m[1][2];
+    a[5][l] = m[k].m[2][2];
+    for (i = 0; i < 9; i++)
+      v[i][l] = i % 4 == 0;
+  }
+  for (k = 0; k < M3SWEEP; k++) {
+    m3rot(a[0], a[3], a[1], a[2], a[4], v, 0, 1);
+    m3rot(a[0], a[5], a[2], a[1], a[4], v, 0, 2);
+    m3rot(a[3], a[5], a[4], a[1], a[2], v, 1, 2);
+  }
+  for (l = 0; l < cnt; l++) {
+    d[0] = a[0][l];
+    d[1] = a[3][l];
+    d[2] = a[5][l];
+    o[0] = 0;
+    o[1] = 1;
+    o[2] = 2;
+    for (i = 0; i < 2; i++)
+      for (j = 2; j > i; j--)
+        if (d[o[j]] < d[o[j - 1]]) {
+          k = o[j];
+          o[j] = o[j - 1];
+          o[j - 1] = k;
+        }
+    val[l] = (v3){d[o[0]], d[o[1]], d[o[2]]};
+    for (i = 0; i < 3; i++)
+      for (j = 0; j < 3; j++)
+        vec[l].m[i][j] = v[j * 3 + o[i]][l];
+  }
+}
+
+/**
+ * batched symmetric 3x3 eigen decomposition.
+ * a jacobi solver run on blocks of M3BLOCK matrices
+ * with a fixed sweep count.
+ * only the upper triangle of each matrix is read. for a
+ * covariance, vec row 0 is the surface normal.
+ *
+ * @param a array of n symmetric m3
+ * @param val array of n v3 eigenvalues out, ascending
+ * @param vec array of n m3 out, row i the unit eigenvector of val i
+ * @param n number of matrices
+ * @return void
+ */
+void m3eig(const m3 *a, v3 *val, m3 *vec, int n) {
+  int i;
+  for (i = 0; i < n; i += M3BLOCK)
+    m3eigblock(a + i, n - i < M3BLOCK ? n - i : M3BLOCK, val + i, vec + i);
+}
+
+/** unit vector perpendicular to u */
+static v3 m3perp(v3 u) {
+  v3 a = u.x * u.x < u.y * u.y ? (u.x * u.x < u.z * u.z ? (v3){1, 0, 0} : (v3){0, 0, 1})
+                               : (u.y * u.y < u.z * u.z ? (v3){0, 1, 0} : (v3){0, 0, 1});
+  v3 c = {u.y * a.z - u.z * a.y, u.z * a.x - u.x * a.z, u.x * a.y - u.y * a.x};
+  return v3norm(c);
+}
+
+/**
+ * batched 3x3 singular value decomposition.
+ * m = sum over k of s[k] u.m[k] v.m[k]^T, where rows of
+ * u and v are the left and right singular vectors. v comes
+ * from the eigenvectors of m^T m, u from m v, orthogonalized
+ * so rank deficient matrices still give a full basis.
+ *
+ * @param a array of n m3
+ * @param u array of n m3 left singular vectors out
+ * @param s array of n v3 singular values out, descending
+ * @param v array of n m3 right singular vectors out
+ * @param n number of matrices
+ * @return void
+ */
+void m3svd(const m3 *a, m3 *u, v3 *s, m3 *v, int n) {
+  m3 b[M3BLOCK], e[M3BLOCK];
+  v3 lam[M3BLOCK], w[3], r[3], x;
+  float sv[3], d;
+  int i, l, k, j, c, cnt;
+  for (i = 0; i < n; i += M3BLOCK) {
+    cnt = n - i < M3BLOCK ? n - i : M3BLOCK;
+    for (l = 0; l < cnt; l++)
+      for (j = 0; j < 3; j++)
+        for (c = 0; c < 3; c++)
+          b[l].m[j][c] = a[i + l].m[0][j] * a[i + l].m[0][c] +
+                         a[i + l].m[1][j] * a[i + l].m[1][c] +
+                         a[i + l].m[2][j] * a[i + l].m[2][c];
+    m3eigblock(b, cnt, lam, e);
+    for (l = 0; l < cnt; l++) {
+      /* descending right vectors and their images m v */
+      for (k = 0; k < 3; k++) {
+        r[k] = (v3){e[l].m[2 - k][0], e[l].m[2 - k][1], e[l].m[2 - k][2]};
+        w[k].x = v3v3dot((v3){a[i + l].m[0][0], a[i + l].m[0][1], a[i + l].m[0][2]}, r[k]);
+        w[k].y = v3v3dot((v3){a[i + l].m[1][0], a[i + l].m[1][1], a[i + l].m[1][2]}, r[k]);
+        w[k].z = v3v3dot((v3){a[i + l].m[2][0], a[i + l].m[2][1], a[i + l].m[2][2]}, r[k]);
+      }
+      sv[0] = v3mag(w[0]);
+      w[0] = sv[0] > 0 ? v3scl(w[0], 1 / sv[0]) : (v3){1, 0, 0};
+      w[1] = v3v3sub(w[1], v3scl(w[0], v3v3dot(w[1], w[0])));
+      sv[1] = v3mag(w[1]);
+      w[1] = sv[1] > sv[0] * 1e-6f ? v3scl(w[1], 1 / sv[1]) : m3perp(w[0]);
+      /* last left vector completes the basis, its sign keeps s[2] >= 0 */
+      x = (v3){w[0].y * w[1].z - w[0].z * w[1].y,
+               w[0].z * w[1].x - w[0].x * w[1].z,
+               w[0].x * w[1].y - w[0].y * w[1].x};
+      d = v3v3dot(w[2], x);
+      sv[2] = d < 0 ? -d : d;
+      w[2] = d < 0 ? v3scl(x, -1) : x;
+      for (k = 0; k < 3; k++) {
+        u[i + l].m[k][0] = w[k].x;
+        u[i + l].m[k][1] = w[k].y;
+        u[i + l].m[k][2] = w[k].z;
+        v[i + l].m[k][0] = r[k].x;
+        v[i + l].m[k][1] = r[k].y;
+        v[i + l].m[k][2] = r[k].z;
+      }
+      s[i + l] = (v3){sv[0], sv[1], sv[2]};
+    }
+  }
+}
+
+/*---- rigid registration functions ----*/
+
+/**
+ * point to point rigid step.
+ * kabsch: the rotation comes from the svd of the cross
+ * covariance of the centred pairs, with the smallest
+ * axis flipped if it would be a reflection.
+ */
+static int icpkabsch(const v3 *p, const v3 *q, const int *nn, int n, a3 *inc) {
+  double pc[3] = {0, 0, 0}, qc[3] = {0, 0, 0}, h[3][3] = {{0}};
+  int i, j, k, c = 0;
+  float d;
+  m3 hm, u, v;
+  v3 s, a, b;
+  for (i = 0; i < n; i++)
+    if (nn[i] >= 0) {
+      pc[0] += p[i].x;
+      pc[1] += p[i].y;
+      pc[2] += p[i].z;
+      qc[0] += q[nn[i]].x;
+      qc[1] += q[nn[i]].y;
+      qc[2] += q[nn[i]].z;
+      c++;
+    }
+  if (c < 3)
+    return 0;
+  for (j = 0; j < 3; j++) {
+    pc[j] /= c;
+    qc[j] /= c;
+  }
+  for (i = 0; i < n; i++)
+    if (nn[i] >= 0) {
+      a = (v3){p[i].x - pc[0], p[i].y - pc[1], p[i].z - pc[2]};
+      b = (v3){q[nn[i]].x - qc[0], q[nn[i]].y - qc[1], q[nn[i]].z - qc[2]};
+      h[0][0] += a.x * b.x;
+      h[0][1] += a.x * b.y;
+      h[0][2] += a.x * b.z;
+      h[1][0] += a.y * b.x;
+      h[1][1] += a.y * b.y;
+      h[1][2] += a.y * b.z;
+      h[2][0] += a.z * b.x;
+      h[2][1] += a.z * b.y;
+      h[2][2] += a.z * b.z;
+    }
+  for (j = 0; j < 3; j++)
+    for (k = 0; k < 3; k++)
+      hm.m[j][k] = h[j][k];
+  m3svd(&hm, &u, &s, &v, 1);
+  for (j = 0; j < 3; j++)
+    for (k = 0; k < 3; k++)
+      inc->m[j][k] = u.m[0][j] * v.m[0][k] + u.m[1][j] * v.m[1][k] +
+                     u.m[2][j] * v.m[2][k];
+  d = inc->m[0][0] * (inc->m[1][1] * inc->m[2][2] - inc->m[1][2] * inc->m[2][1]) -
+      inc->m[0][1] * (inc->m[1][0] * inc->m[2][2] - inc->m[1][2] * inc->m[2][0]) +
+      inc->m[0][2] * (inc->m[1][0] * inc->m[2][1] - inc->m[1][1] * inc->m[2][0]);
+  if (d < 0)
+    for (j = 0; j < 3; j++)
+      for (k = 0; k < 3; k++)
+        inc->m[j][k] -= 2 * u.m[2][j] * v.m[2][k];
+  for (k = 0; k < 3; k++)
+    inc->m[3][k] = qc[k] - (pc[0] * inc->m[0][k] + pc[1] * inc->m[1][k] +
+                            pc[2] * inc->m[2][k]);
+  return 1;
+}
+
+/**
+ * point to plane rigid step.
+ * linearizes the rotation about the centroid of the
+ * matched points and solves the 6x6 normal equations,
+ * then builds an exact rotation from the solved angles.
+ */
+static int icpplane(const v3 *p, const v3 *q, const v3 *nrm, const int *nn,
+                    int n, a3 *inc) {
+  float ata[36] = {0}, atb[6] = {0}, row[6], r, th, sn, cs;
+  double pc[3] = {0, 0, 0};
+  mn ma = {6, 6, 6, NULL, NULL}, mb = {6, 1, 1, NULL, NULL};
+  int i, j, k, c = 0;
+  v3 a, nm, w;
+  for (i = 0; i < n; i++)
+    if (nn[i] >= 0) {
+      pc[0] += p[i].x;
+      pc[1] += p[i].y;
+      pc[2] += p[i].z;
+      c++;
+    }
+  if (c < 6)
+    return 0;
+  for (j = 0; j < 3; j++)
+    pc[j] /= c;
+  for (i = 0; i < n; i++)
+    if (nn[i] >= 0) {
+      a = (v3){p[i].x - pc[0], p[i].y - pc[1], p[i].z - pc[2]};
+      nm = nrm[nn[i]];
+      row[0] = a.y * nm.z - a.z * nm.y;
+      row[1] = a.z * nm.x - a.x * nm.z;
+      row[2] = a.x * nm.y - a.y * nm.x;
+      row[3] = nm.x;
+      row[4] = nm.y;
+      row[5] = nm.z;
+      r = v3v3dot(v3v3sub(q[nn[i]], p[i]), nm);
+      for (j = 0; j < 6; j++) {
+        atb[j] += row[j] * r;
+        for (k = 0; k <= j; k++)
+          ata[j * 6 + k] += row[j] * row[k];
+      }
+    }
+  ma.a = ata;
+  mb.a = atb;
+  if (!mnchol(ma))
+    return 0;
+  mncholsolve(ma, mb);
+  /* rodrigues on the solved angles, transposed for row vectors */
+  w = (v3){atb[0], atb[1], atb[2]};
+  th = v3mag(w);
+  w = th > 0 ? v3scl(w, 1 / th) : w;
+  sn = sin(th);
+  cs = cos(th);
+  inc->m[0][0] = cs + (1 - cs) * w.x * w.x;
+  inc->m[0][1] = (1 - cs) * w.x * w.y + sn * w.z;
+  inc->m[0][2] = (1 - cs) * w.x * w.z - sn * w.y;
+  inc->m[1][0] = (1 - cs) * w.y * w.x - sn * w.z;
+  inc->m[1][1] = cs + (1 - cs) * w.y * w.y;
+  inc->m[1][2] = (1 - cs) * w.y * w.z + sn * w.x;
+  inc->m[2][0] = (1 - cs) * w.z * w.x + sn * w.y;
+  inc->m[2][1] = (1 - cs) * w.z * w.y - sn * w.x;
+  inc->m[2][2] = cs + (1 - cs) * w.z * w.z;
+  /* rotate about the centroid, then translate */
+  for (k = 0; k < 3; k++)
+    inc->m[3][k] = pc[k] + atb[3 + k] -
+                   (pc[0] * inc->m[0][k] + pc[1] * inc->m[1][k] +
+                    pc[2] * inc->m[2][k]);
+  return 1;
+}
+
+/**
+ * iterative closest point rigid registration.
+ * each iteration moves src by the current transform, pairs
+ * every point with its nearest dst point through t, and
+ * solves for the rigid step that best aligns the pairs,
+ * point to point, or point to plane when normals are given.
+ * iteration stops once the rms pair distance improves by
+ * less than eps relative to the last iteration.
+ *
+ * @param t kdtree from kdbuild3 over dst
+ * @param dst array of target v3 points
+ * @param nrm array of unit target normals, NULL for point to point
+ * @param src array of n v3 points to align
+ * @param n number of src points
+ * @param m m4 initial guess in, rigid transform taking src onto dst
+ *          out, for use with m4xv3
+ * @param iters max iterations
+ * @param maxd pairs farther apart are rejected, 0 keeps every pair
+ * @param eps relative rms improvement to stop at
+ * @param err rms pair distance at the final transform out, may be NULL
+ * @return number of iterations run, or -1 if allocation fails
+ */
+int icp(const kdtree *t, const v3 *dst, const v3 *nrm, const v3 *src, int n,
+        m4 *m, int iters, float maxd, float eps, float *err) {
+  v3 *p = malloc(sizeof(v3) * (n > 0 ? n : 1));
+  int *nn = malloc(sizeof(int) * (n > 0 ? n : 1));
+  float md2 = maxd > 0 ? maxd * maxd : HUGE_VAL, d2[1], rms, prev = 0;
+  double sum;
+  int i, it, c;
+  a3 cur = m4toa3(*m), inc;
+  if (!p || !nn) {
+    free(p);
+    free(nn);
+    return -1;
+  }
+  for (it = 0;; it++) {
+    a3xv3n(cur, src, p, n);
+    for (i = 0, sum = 0, c = 0; i < n; i++)
+      if (kdknn3(t, p[i], 1, nn + i, d2) < 1 || d2[0] > md2) {
+        nn[i] = -1;
+      } else {
+        sum += d2[0];
+        c++;
+      }
+    rms = c > 0 ? sqrt(sum / c) : 0;
+    if (it == iters || c == 0 || rms == 0 ||
+        (it > 0 && prev - rms <= eps * prev))
+      break;
+    if (!(nrm ? icpplane(p, dst, nrm, nn, n, &inc)
+              : icpkabsch(p, dst, nn, n, &inc)))
+      break;
+    cur = a3xa3(cur, inc);
+    prev = rms;
+  }
+  if (err)
+    *err = rms;
+  *m = a3tom4(cur);
+  free(p);
+  free(nn);
+  return it;
+}
+
+/*---- mesh simplification functions ----*/
+
+/* quadric collapse candidate, stale once a or b has moved on */
+typedef struct qement {
+  float cost, err;
+  int a, b, sa, sb;
+} qement;
+
+/* simplifier state */
+typedef struct qemq {
+  m4 *q;
+  v3 *v;
+  int *tri, *next, *head, *stamp, *parent, *mark, *border;
+  qement *heap;
+  int nheap, cap, round;
+} qemq;
+
+/** add w p p^T for plane p to quadric q */
+static void qemplane(m4 *q, v4 p, float w) {
+  float e[4];
+  int i, j;
+  e[0] = p.x;
+  e[1] = p.y;
+  e[2] = p.z;
+  e[3] = p.w;
+  for (i = 0; i < 4; i++)
+    for (j = 0; j < 4; j++)
+      q->m[i][j] += w * e[i] * e[j];
+}
+
+/** error of quadric q at point p */
+static float qemerr(const m4 *q, v3 p) {
+  float e = q->m[0][0] * p.x * p.x + q->m[1][1] * p.y * p.y +
+            q->m[2][2] * p.z * p.z + q->m[3][3] +
+            2 * (q->m[0][1] * p.x * p.y + q->m[0][2] * p.x * p.z +
+                 q->m[1][2] * p.y * p.z + q->m[0][3] * p.x +
+                 q->m[1][3] * p.y + q->m[2][3] * p.z);
+  return e > 0 ? e : 0;
+}
+
+/**
+ * cheapest point for collapsing a and b.
+ * the minimizer of the summed quadric when its linear
+ * part is well conditioned, otherwise or if it does no
+ * better, an endpoint or the midpoint.
+ */
+static float qemcost(const qemq *s, int a, int b, v3 *out) {
+  m4 q;
+  float r[6], d, c, best, t;
+  v3 p, m;
+  int i, j;
+  for (i = 0; i < 4; i++)
+    for (j = 0; j < 4; j++)
+      q.m[i][j] = s->q[a].m[i][j] + s->q[b].m[i][j];
+  m = v3scl(v3v3add(s->v[a], s->v[b]), 0.5f);
+  *out = s->v[a];
+  best = qemerr(&q, s->v[a]);
+  if ((c = qemerr(&q, s->v[b])) < best) {
+    best = c;
+    *out = s->v[b];
+  }
+  if ((c = qemerr(&q, m)) < best) {
+    best = c;
+    *out = m;
+  }
+  /* adjugate of the symmetric linear part */
+  r[0] = q.m[1][1] * q.m[2][2] - q.m[1][2] * q.m[1][2];
+  r[1] = q.m[0][2] * q.m[1][2] - q.m[0][1] * q.m[2][2];
+  r[2] = q.m[0][1] * q.m[1][2] - q.m[0][2] * q.m[1][1];
+  r[3] = q.m[0][0] * q.m[2][2] - q.m[0][2] * q.m[0][2];
+  r[4] = q.m[0][1] * q.m[0][2] - q.m[0][0] * q.m[1][2];
+  r[5] = q.m[0][0] * q.m[1][1] - q.m[0][1] * q.m[0][1];
+  d = q.m[0][0] * r[0] + q.m[0][1] * r[1] + q.m[0][2] * r[2];
+  t = q.m[0][0] + q.m[1][1] + q.m[2][2];
+  if (d > 1e-6f * t * t * t) {
+    p.x = -(r[0] * q.m[0][3] + r[1] * q.m[1][3] + r[2] * q.m[2][3]) / d;
+    p.y = -(r[1] * q.m[0][3] + r[3] * q.m[1][3] + r[4] * q.m[2][3]) / d;
+    p.z = -(r[2] * q.m[0][3] + r[4] * q.m[1][3] + r[5] * q.m[2][3]) / d;
+    if ((c = qemerr(&q, p)) < best) {
+      best = c;
+      *out = p;
+    }
+  }
+  return best;
+}
+
+/** sift e down the heap from slot i */
+static void qemsift(qemq *s, int i, qement e) {
+  int c;
+  while ((c = 2 * i + 1) < s->nheap) {
+    if (c + 1 < s->nheap && s->heap[c + 1].cost < s->heap[c].cost)
+      c++;
+    if (s->heap[c].cost >= e.cost)
+      break;
+    s->heap[i] = s->heap[c];
+    i = c;
+  }
+  s->heap[i] = e;
+}
+
+/** drop stale collapses and rebuild the heap */
+static void qempurge(qemq *s) {
+  int i, n = 0;
+  qement e;
+  for (i = 0; i < s->nheap; i++) {
+    e = s->heap[i];
+    if (s->parent[e.a] == e.a && s->parent[e.b] == e.b &&
+        s->stamp[e.a] == e.sa && s->stamp[e.b] == e.sb)
+      s->heap[n++] = e;
+  }
+  s->nheap = n;
+  for (i = n / 2 - 1; i >= 0; i--)
+    qemsift(s, i, s->heap[i]);
+}
+
+/**
+ * push the collapse of a and b onto the heap.
+ * a live entry is one current edge, and edges only merge
+ * as collapses go, so with room for twice the starting
+ * edges a purge always frees at least half the heap.
+ */
+static void qempush(qemq *s, int a, int b) {
+  qement e;
+  int i, p;
+  v3 x;
+  if (s->nheap == s->cap)
+    qempurge(s);
+  /* the length term breaks ties on flat patches, where every
+     collapse is free, in favour of short edges so no vertex
+     swallows a whole fan */
+  x = v3v3sub(s->v[a], s->v[b]);
+  e.cost = v3v3dot(x, x);
+  e.err = qemcost(s, a, b, &x);
+  e.cost = 1e-4f * e.cost * e.cost + e.err;
+  e.a = a;
+  e.b = b;
+  e.sa = s->stamp[a];
+  e.sb = s->stamp[b];
+  for (i = s->nheap++; i > 0 && s->heap[p = (i - 1) / 2].cost > e.cost; i = p)
+    s->heap[i] = s->heap[p];
+  s->heap[i] = e;
+}
+
+/** pop the cheapest collapse off the heap */
+static qement qempop(qemq *s) {
+  qement top = s->heap[0];
+  s->nheap--;
+  qemsift(s, 0, s->heap[s->nheap]);
+  return top;
+}
+
+/** true if moving v to p would flip a face around it that survives */
+static int qemflip(const qemq *s, int v, int other, v3 p) {
+  int c, f, i1, i2;
+  v3 a, b, e1, e2, n1;
+  float d, n0x, n0y, n0z;
+  for (c = s->head[v]; c >= 0; c = s->next[c]) {
+    f = c - c % 3;
+    if (s->tri[f] < 0)
+      continue;
+    i1 = s->tri[f + (c % 3 + 1) % 3];
+    i2 = s->tri[f + (c % 3 + 2) % 3];
+    if (i1 == other || i2 == other)
+      continue;
+    e1 = v3v3sub(s->v[i1], s->v[v]);
+    e2 = v3v3sub(s->v[i2], s->v[v]);
+    n0x = e1.y * e2.z - e1.z * e2.y;
+    n0y = e1.z * e2.x - e1.x * e2.z;
+    n0z = e1.x * e2.y - e1.y * e2.x;
+    a = v3v3sub(s->v[i1], p);
+    b = v3v3sub(s->v[i2], p);
+    n1 = (v3){a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+    d = n0x * n1.x + n0y * n1.y + n0z * n1.z;
+    /* reject turning the face by more than 45 degrees */
+    if (d <= 0 || d * d < 0.5f * (n0x * n0x + n0y * n0y + n0z * n0z) * v3v3dot(n1, n1))
+      return 1;
+  }
+  return 0;
+}
+
+/** true if a has a live face on x and y */
+static int qemface(const qemq *s, int a, int x, int y) {
+  int c, f, k, hx, hy;
+  for (c = s->head[a]; c >= 0; c = s->next[c]) {
+    f = c - c % 3;
+    if (s->tri[f] < 0)
+      continue;
+    for (k = 0, hx = hy = 0; k < 3; k++) {
+      hx |= s->tri[f + k] == x;
+      hy |= s->tri[f + k] == y;
+    }
+    if (hx && hy)
+      return 1;
+  }
+  return 0;
+}
+
+/**
+ * link condition for collapsing b into a.
+ * the only vertices next to both a and b may be the ones
+ * opposite the edge, no face of b may turn into a face a
+ * already has, and two border vertices may only join along
+ * a border edge. otherwise the collapse would leave fins,
+ * duplicate faces or a pinched border.
+ */
+static int qemlink(qemq *s, int a, int b) {
+  int c, f, k, x, y, ra, ro, share = 0, hasa;
+  ra = ++s->round;
+  for (c = s->head[a]; c >= 0; c = s->next[c]) {
+    f = c - c % 3;
+    if (s->tri[f] >= 0)
+      for (k = 0; k < 3; k++)
+        s->mark[s->tri[f + k]] = ra;
+  }
+  ro = ++s->round;
+  for (c = s->head[b]; c >= 0; c = s->next[c]) {
+    f = c - c % 3;
+    if (s->tri[f] < 0)
+      continue;
+    x = s->tri[f + (c % 3 + 1) % 3];
+    y = s->tri[f + (c % 3 + 2) % 3];
+    if (x == a || y == a) {
+      s->mark[x == a ? y : x] = ro;
+      share++;
+    }
+  }
+  if (s->border[a] && s->border[b] && share != 1)
+    return 0;
+  for (c = s->head[b]; c >= 0; c = s->next[c]) {
+    f = c - c % 3;
+    if (s->tri[f] < 0)
+      continue;
+    x = s->tri[f + (c % 3 + 1) % 3];
+    y = s->tri[f + (c % 3 + 2) % 3];
+    hasa = x == a || y == a;
+    if (!hasa && (s->mark[x] == ra || s->mark[y] == ra))
+      return 0;
+    if (!hasa && s->mark[x] == ro && s->mark[y] == ro && qemface(s, a, x, y))
+      return 0;
+  }
+  return 1;
+}
+
+/** follow collapses to the surviving vertex */
+static int qemfind(int *parent, int v) {
+  int r = v, t;
+  while (parent[r] != r)
+    r = parent[r];
+  while (parent[v] != r) {
+    t = parent[v];
+    parent[v] = r;
+    v = t;
+  }
+  return r;
+}
+
+/**
+ * quadric error mesh simplification.
+ * each vertex carries the area weighted plane quadrics of
+ * its faces as an m4, with heavy planes through boundary
+ * edges so open borders hold their shape. edges collapse
+ * cheapest first from a binary heap to the point that
+ * minimizes the summed quadric, skipping collapses that
+ * would flip a face or break the link condition, so a
+ * manifold mesh stays manifold. vertices and triangles
+ * are compacted in place. everything is allocated before
+ * the mesh is touched, so on failure it is left as it was.
+ *
+ * @param v array of *nv v3 positions, overwritten
+ * @param nv number of vertices in, surviving vertices out
+ * @param tri array of 3 * ntri vertex indices, overwritten
+ * @param ntri number of triangles
+ * @param target triangle count to stop at
+ * @param maxerr largest quadric error to collapse, 0 for no limit
+ * @param remap array of *nv indices out, new index of each
+ *        old vertex or -1 if no triangle uses it, may be NULL
+ * @return number of triangles left, or -1 if allocation fails
+ *         with v, nv and tri untouched
+ */
+int qemsimplify(v3 *v, int *nv, int *tri, int ntri, int target,
+                float maxerr, int *remap) {
+  qemq s;
+  qement e;
+  uint64_t *key = malloc(sizeof(uint64_t) * (3 * ntri + 1));
+  int *perm = malloc(sizeof(int) * (3 * ntri + 1));
+  int n = *nv, live = ntri, i, j, k, c, f, a, b, last, ok = 1;
+  float w, len;
+  v3 e1, e2, nm, p;
+  s.v = v;
+  s.tri = tri;
+  s.q = calloc(n + 1, sizeof(m4));
+  s.next = malloc(sizeof(int) * (3 * ntri + 1));
+  s.head = malloc(sizeof(int) * (n + 1));
+  s.stamp = calloc(n + 1, sizeof(int));
+  s.parent = malloc(sizeof(int) * (n + 1));
+  s.mark = calloc(n + 1, sizeof(int));
+  s.border = calloc(n + 1, sizeof(int));
+  s.cap = 6 * ntri + 16;
+  s.nheap = 0;
+  s.round = 0;
+  s.heap = malloc(sizeof(qement) * s.cap);
+  if (!key || !perm || !s.q || !s.next || !s.head || !s.stamp ||
+      !s.parent || !s.mark || !s.border || !s.heap)
+    ok = 0;
+  for (i = 0; ok && i < n; i++) {
+    s.head[i] = -1;
+    s.parent[i] = i;
+  }
+  /* face quadrics, corner lists and edge keys */
+  for (f = 0; ok && f < ntri; f++) {
+    e1 = v3v3sub(v[tri[3 * f + 1]], v[tri[3 * f]]);
+    e2 = v3v3sub(v[tri[3 * f + 2]], v[tri[3 * f]]);
+    nm = (v3){e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z,
+              e1.x * e2.y - e1.y * e2.x};
+    w = v3mag(nm);
+    nm = w > 0 ? v3scl(nm, 1 / w) : nm;
+    for (k = 0; k < 3; k++) {
+      a = tri[3 * f + k];
+      b = tri[3 * f + (k + 1) % 3];
+      qemplane(s.q + a, (v4){nm.x, nm.y, nm.z, -v3v3dot(nm, v[tri[3 * f]])}, 0.5f * w);
+      s.next[3 * f + k] = s.head[a];
+      s.head[a] = 3 * f + k;
+      key[3 * f + k] = a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a;
+    }
+  }
+  if (ok && !mortonsort64(key, perm, 3 * ntri))
+    ok = 0;
+  /* unique edges become candidates, lone edges are borders */
+  for (i = 0; ok && i < 3 * ntri; i = j) {
+    for (j = i + 1; j < 3 * ntri && key[j] == key[i]; j++)
+      ;
+    a = key[i] >> 32;
+    b = key[i] & 0xffffffffu;
+    if (j - i == 1) {
+      c = perm[i];
+      f = c - c % 3;
+      e1 = v3v3sub(v[tri[f + 1]], v[tri[f]]);
+      e2 = v3v3sub(v[tri[f + 2]], v[tri[f]]);
+      nm = (v3){e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z,
+                e1.x * e2.y - e1.y * e2.x};
+      e1 = v3v3sub(v[b], v[a]);
+      len = v3v3dot(e1, e1);
+      nm = (v3){e1.y * nm.z - e1.z * nm.y, e1.z * nm.x - e1.x * nm.z,
+                e1.x * nm.y - e1.y * nm.x};
+      w = v3mag(nm);
+      if (w > 0) {
+        nm = v3scl(nm, 1 / w);
+        qemplane(s.q + a, (v4){nm.x, nm.y, nm.z, -v3v3dot(nm, v[a])}, 100 * len);
+        qemplane(s.q + b, (v4){nm.x, nm.y, nm.z, -v3v3dot(nm, v[a])}, 100 * len);
+      }
+      s.border[a] = s.border[b] = 1;
+    }
+    if (a != b)
+      qempush(&s, a, b);
+  }
+  while (ok && live > target && s.nheap > 0) {
+    e = qempop(&s);
+    a = e.a;
+    b = e.b;
+    if (s.parent[a] != a || s.parent[b] != b ||
+        s.stamp[a] != e.sa || s.stamp[b] != e.sb)
+      continue;
+    if ((maxerr > 0 && e.err > maxerr) || !qemlink(&s, a, b))
+      continue;
+    qemcost(&s, a, b, &p);
+    if (qemflip(&s, a, b, p) || qemflip(&s, b, a, p))
+      continue;
+    /* kill shared faces, move b's corners onto a */
+    for (c = s.head[b], last = -1; c >= 0; c = s.next[c]) {
+      f = c - c % 3;
+      if (s.tri[f] >= 0 && (s.tri[f] == a || s.tri[f + 1] == a || s.tri[f + 2] == a)) {
+        s.tri[f] = s.tri[f + 1] = s.tri[f + 2] = -1;
+        live--;
+      }
+      if (s.tri[f] >= 0)
+        s.tri[c] = a;
+      last = c;
+    }
+    if (last >= 0) {
+      s.next[last] = s.head[a];
+      s.head[a] = s.head[b];
+    }
+    s.head[b] = -1;
+    s.parent[b] = a;
+    s.border[a] |= s.border[b];
+    for (i = 0; i < 4; i++)
+      for (j = 0; j < 4; j++)
+        s.q[a].m[i][j] += s.q[b].m[i][j];
+    v[a] = p;
+    s.stamp[a]++;
+    /* drop dead corners from a and requeue its edges */
+    s.round++;
+    for (c = s.head[a], last = -1; c >= 0; c = s.next[c]) {
+      f = c - c % 3;
+      if (s.tri[f] < 0) {
+        if (last < 0)
+          s.head[a] = s.next[c];
+        else
+          s.next[last] = s.next[c];
+        continue;
+      }
+      last = c;
+      for (k = 1; k < 3; k++) {
+        j = s.tri[f + (c % 3 + k) % 3];
+        if (j != a && s.mark[j] != s.round) {
+          s.mark[j] = s.round;
+          qempush(&s, a, j);
+        }
+      }
+    }
+  }
+  /* compact vertices then triangles */
+  if (ok) {
+    for (i = 0; i < n; i++)
+      s.mark[i] = -1;
+    for (f = 0; f < ntri; f++)
+      if (tri[3 * f] >= 0)
+        for (k = 0; k < 3; k++)
+          s.mark[tri[3 * f + k]] = 0;
+    for (i = 0, k = 0; i < n; i++)
+      if (s.mark[i] == 0) {
+        v[k] = v[i];
+        s.mark[i] = k++;
+      }
+    if (remap)
+      for (i = 0; i < n; i++)
+        remap[i] = s.mark[qemfind(s.parent, i)];
+    *nv = k;
+    for (f = 0, j = 0; f < ntri; f++)
+      if (tri[3 * f] >= 0) {
+        for (k = 0; k < 3; k++)
+          tri[3 * j + k] = s.mark[tri[3 * f + k]];
+        j++;
+      }
+  }
+  free(key);
+  free(perm);
+  free(s.q);
+  free(s.next);
+  free(s.head);
+  free(s.stamp);
+  free(s.parent);
+  free(s.mark);
+  free(s.border);
+  free(s.heap);
+  return ok ? j : -1;
+}
+
+/*---- mesh normal functions ----*/
+
+/** unnormalized normal of face f, twice its area long */
+static v3 trinrmof(const v3 *v, const int *tri, int f) {
+  v3 a = v[tri[3 * f]];
+  v3 e1 = v3v3sub(v[tri[3 * f + 1]], a), e2 = v3v3sub(v[tri[3 * f + 2]], a);
+  return (v3){e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z,
+              e1.x * e2.y - e1.y * e2.x};
+}
+
+/**
+ * normalize n v3 in place, zero vectors stay zero.
+ * with sse2, 4 vectors are 3 loads: their squares are
+ * regrouped into x, y and z lanes by shuffles, and the
+ * scales spread back the same way.
+ */
+static void v3unitn(v3 *p, int n) {
+  int i = 0;
+  float l;
+#ifdef __SSE2__
+  float *f;
+  __m128 a, b, c, sa, sb, sc, x, y, z, r, in;
+  for (; i + 4 <= n; i += 4) {
+    f = &p[i].x;
+    a = _mm_loadu_ps(f);
+    b = _mm_loadu_ps(f + 4);
+    c = _mm_loadu_ps(f + 8);
+    sa = _mm_mul_ps(a, a);
+    sb = _mm_mul_ps(b, b);
+    sc = _mm_mul_ps(c, c);
+    x = _mm_shuffle_ps(_mm_shuffle_ps(sa, sa, _MM_SHUFFLE(3, 3, 0, 0)),
+                       _mm_shuffle_ps(sb, sc, _MM_SHUFFLE(1, 1, 2, 2)),
+                       _MM_SHUFFLE(2, 0, 2, 0));
+    y = _mm_shuffle_ps(_mm_shuffle_ps(sa, sb, _MM_SHUFFLE(0, 0, 1, 1)),
+                       _mm_shuffle_ps(sb, sc, _MM_SHUFFLE(2, 2, 3, 3)),
+                       _MM_SHUFFLE(2, 0, 2, 0));
+    z = _mm_shuffle_ps(_mm_shuffle_ps(sa, sb, _MM_SHUFFLE(1, 1, 2, 2)),
+                       _mm_shuffle_ps(sc, sc, _MM_SHUFFLE(3, 3, 0, 0)),
+                       _MM_SHUFFLE(2, 0, 2, 0));
+    x = _mm_add_ps(_mm_add_ps(x, y), z);
+    r = _mm_div_ps(_mm_set1_ps(1), _mm_sqrt_ps(x));
+    in = _mm_cmpgt_ps(x, _mm_setzero_ps());
+    r = _mm_or_ps(_mm_and_ps(in, r), _mm_andnot_ps(in, _mm_set1_ps(1)));
+    x = _mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 0, 0, 0));
+    y = _mm_shuffle_ps(r, r, _MM_SHUFFLE(2, 2, 1, 1));
+    z = _mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 2));
+    _mm_storeu_ps(f, _mm_mul_ps(a, x));
+    _mm_storeu_ps(f + 4, _mm_mul_ps(b, y));
+    _mm_storeu_ps(f + 8, _mm_mul_ps(c, z));
+  }
+#endif
+  for (; i < n; i++) {
+    l = v3v3dot(p[i], p[i]);
+    p[i] = l > 0 ? v3scl(p[i], 1 / sqrtf(l)) : p[i];
+  }
+}
+
+/** angle at corner c of its face, l is the length of the face normal */
+static float trinrmang(const v3 *v, const int *tri, int c, float l) {
+  int f = c - c % 3;
+  v3 e1 = v3v3sub(v[tri[f + (c % 3 + 1) % 3]], v[tri[c]]);
+  v3 e2 = v3v3sub(v[tri[f + (c % 3 + 2) % 3]], v[tri[c]]);
+  /* |e1 x e2| is l, so the corner angle needs no acos */
+  return atan2(l, v3v3dot(e1, e2));
+}
+
+/** weight of face normal n at corner c, area or corner angle */
+static v3 trinrmat(const v3 *v, const int *tri, int c, v3 n, int angle) {
+  float l = v3v3dot(n, n);
+  if (!angle || l == 0)
+    return n;
+  l = sqrtf(l);
+  return v3scl(n, trinrmang(v, tri, c, l) / l);
+}
+
+/**
+ * batched face normals.
+ * degenerate faces get a zero normal.
+ *
+ * @param v array of v3 positions
+ * @param tri array of 3 * ntri vertex indices
+ * @param ntri number of triangles
+ * @param fn array of ntri unit v3 normals out
+ * @param area array of ntri face areas out, may be NULL
+ * @return void
+ */
+void trinrm(const v3 *v, const int *tri, int ntri, v3 *fn, float *area) {
+  int f;
+  for (f = 0; f < ntri; f++)
+    fn[f] = trinrmof(v, tri, f);
+  if (area)
+    for (f = 0; f < ntri; f++)
+      area[f] = 0.5f * sqrtf(v3v3dot(fn[f], fn[f]));
+  v3unitn(fn, ntri);
+}
+
+/**
+ * batched vertex normals.
+ * face normals are weighted by face area, or by the
+ * corner angle when angle is set, scattered onto their
+ * vertices and normalized. vertices without faces get
+ * a zero normal.
+ *
+ * @param v array of nv v3 positions
+ * @param nv number of vertices
+ * @param tri array of 3 * ntri vertex indices
+ * @param ntri number of triangles
+ * @param angle boolean for angle rather than area weights
+ * @param vn array of nv unit v3 normals out
+ * @return void
+ */
+void vtxnrm(const v3 *v, int nv, const int *tri, int ntri, int angle, v3 *vn) {
+  int i, f, k;
+  v3 n;
+  for (i = 0; i < nv; i++)
+    vn[i] = (v3){0, 0, 0};
+  for (f = 0; f < ntri; f++) {
+    n = trinrmof(v, tri, f);
+    for (k = 0; k < 3; k++)
+      vn[tri[3 * f + k]] = v3v3add(vn[tri[3 * f + k]],
+                                   trinrmat(v, tri, 3 * f + k, n, angle));
+  }
+  v3unitn(vn, nv);
+}
+
+/**
+ * vertex to corner adjacency.
+ * row i lists the corners 3 * f + k with tri[3 * f + k] == i.
+ * only the pattern is stored, val is NULL, so it is not
+ * for csrxv. build it once per topology and split it with
+ * csrsplit and csrview to compute normals per range.
+ *
+ * @param tri array of 3 * ntri vertex indices
+ * @param ntri number of triangles
+ * @param nv number of vertices
+ * @return csr with nv rows, with NULL start if allocation fails
+ */
+csr vtxadj(const int *tri, int ntri, int nv) {
+  csr a;
+  int i, c;
+  a.rows = nv;
+  a.cols = a.nnz = 3 * ntri;
+  a.start = calloc(nv + 1, sizeof(int));
+  a.col = malloc(sizeof(int) * (3 * ntri + 1));
+  a.val = NULL;
+  if (!a.start || !a.col) {
+    csrfree(&a);
+    return a;
+  }
+  for (c = 0; c < 3 * ntri; c++)
+    a.start[tri[c] + 1]++;
+  for (i = 0; i < nv; i++)
+    a.start[i + 1] += a.start[i];
+  for (c = 0; c < 3 * ntri; c++)
+    a.col[a.start[tri[c]]++] = c;
+  for (i = nv; i > 0; i--)
+    a.start[i] = a.start[i - 1];
+  a.start[0] = 0;
+  return a;
+}
+
+/**
+ * vertex normals by gathering over adjacency.
+ * each vertex sums the weighted face normals of its own
+ * corners, so every output is written once and row views
+ * of adj can run on separate threads with no shared
+ * writes. row i of adj writes vn[i]. face normals and
+ * areas come from trinrm, made once per frame, so only
+ * the corner angles are left per corner.
+ *
+ * @param v array of v3 positions, only read for angle weights
+ * @param tri array of vertex indices
+ * @param fn array of unit face normals from trinrm
+ * @param area array of face areas from trinrm
+ * @param adj csr from vtxadj, or a row view of it
+ * @param angle boolean for angle rather than area weights
+ * @param vn array of adj->rows unit v3 normals out
+ * @return void
+ */
+void vtxnrmadj(const v3 *v, const int *tri, const v3 *fn, const float *area,
+               const csr *adj, int angle, v3 *vn) {
+  int i, k, c;
+  float w;
+  v3 s;
+  for (i = 0; i < adj->rows; i++) {
+    s = (v3){0, 0, 0};
+    for (k = adj->start[i]; k < adj->start[i + 1]; k++) {
+      c = adj->col[k];
+      w = angle && area[c / 3] > 0 ? trinrmang(v, tri, c, 2 * area[c / 3])
+                                   : area[c / 3];
+      s = v3v3add(s, v3scl(fn[c / 3], w));
+    }
+    vn[i] = s;
+  }
+  v3unitn(vn, adj->rows);
+}
+
+/*---- clip space functions ----*/
+
+#define CLIPBLOCK 64
+#define CLIPMAX 12
+
+/* clip polygon vertex, position and weights of the source corners */
+typedef struct clipv {
+  v4 p;
+  v3 b;
+} clipv;
+
+/**
+ * clip space outcode.
+ * bits 0-5 are outside -w <= x <= w, -w <= y <= w and
+ * 0 <= z <= w, the volume m4proj maps the view frustum
+ * to. bits 6-9 are outside x and y at g times the width.
+ */
+static unsigned clipcode(v4 p, float g) {
+  float gw = g * p.w;
+  return (p.x < -p.w) | (p.x > p.w) << 1 | (p.y < -p.w) << 2 |
+         (p.y > p.w) << 3 | (p.z < 0) << 4 | (p.z > p.w) << 5 |
+         (p.x < -gw) << 6 | (p.x > gw) << 7 | (p.y < -gw) << 8 |
+         (p.y > gw) << 9;
+}
+
+#ifdef __SSE2__
+/** outcode bit b in the lanes where mask m is set */
+static __m128i clipbit(__m128 m, int b) {
+  return _mm_and_si128(_mm_castps_si128(m), _mm_set1_epi32(1 << b));
+}
+
+/** clipcode of the 4 corners v[idx[0..3]], transposed to one per lane */
+static void clipcode4(const v4 *v, const int *idx, float g, unsigned *code) {
+  __m128 x = _mm_loadu_ps(&v[idx[0]].x), y = _mm_loadu_ps(&v[idx[1]].x);
+  __m128 z = _mm_loadu_ps(&v[idx[2]].x), w = _mm_loadu_ps(&v[idx[3]].x);
+  __m128 sign = _mm_set1_ps(-0.0f), nw, gw, ngw;
+  __m128i c;
+  _MM_TRANSPOSE4_PS(x, y, z, w);
+  nw = _mm_xor_ps(w, sign);
+  gw = _mm_mul_ps(_mm_set1_ps(g), w);
+  ngw = _mm_xor_ps(gw, sign);
+  c = _mm_or_si128(clipbit(_mm_cmplt_ps(x, nw), 0),
+                   clipbit(_mm_cmpgt_ps(x, w), 1));
+  c = _mm_or_si128(c, clipbit(_mm_cmplt_ps(y, nw), 2));
+  c = _mm_or_si128(c, clipbit(_mm_cmpgt_ps(y, w), 3));
+  c = _mm_or_si128(c, clipbit(_mm_cmplt_ps(z, _mm_setzero_ps()), 4));
+  c = _mm_or_si128(c, clipbit(_mm_cmpgt_ps(z, w), 5));
+  c = _mm_or_si128(c, clipbit(_mm_cmplt_ps(x, ngw), 6));
+  c = _mm_or_si128(c, clipbit(_mm_cmpgt_ps(x, gw), 7));
+  c = _mm_or_si128(c, clipbit(_mm_cmplt_ps(y, ngw), 8));
+  c = _mm_or_si128(c, clipbit(_mm_cmpgt_ps(y, gw), 9));
+  _mm_storeu_si128((__m128i *)code, c);
+}
+#endif
+
+/** signed distance of p inside clip plane k, k indexing outcode bits 4-9 */
+static float clipdist(v4 p, float g, int k) {
+  switch (k) {
+  case 4: return p.z;
+  case 5: return p.w - p.z;
+  case 6: return g * p.w + p.x;
+  case 7: return g * p.w - p.x;
+  case 8: return g * p.w + p.y;
+  default: return g * p.w - p.y;
+  }
+}
+
+/** sutherland hodgman pass of polygon in against plane k into out */
+static int clipplane(const clipv *in, int n, clipv *out, float g, int k) {
+  int i, m = 0;
+  float d0, d1, t;
+  clipv a, b;
+  for (i = 0; i < n; i++) {
+    a = in[i];
+    b = in[(i + 1) % n];
+    d0 = clipdist(a.p, g, k);
+    d1 = clipdist(b.p, g, k);
+    if (d0 >= 0)
+      out[m++] = a;
+    if ((d0 >= 0) != (d1 >= 0)) {
+      t = d0 / (d0 - d1);
+      out[m].p = v4v4add(a.p, v4scl(v4v4sub(b.p, a.p), t));
+      out[m].b = v3v3add(a.b, v3scl(v3v3sub(b.b, a.b), t));
+      m++;
+    }
+  }
+  return m;
+}
+
+/**
+ * batched clip space triangle clipping.
+ * an outcode pass over each block of triangles, 4 corners
+ * per step with sse2, accepts triangles inside the clip
+ * volume and rejects those wholly outside one of its
+ * planes. the rest are clipped against the near and far
+ * planes, and against x and y only where they leave the
+ * guard band, then fanned
+ * back into triangles. each output corner carries its
+ * barycentric weights in the source triangle to
+ * interpolate attributes with.
+ *
+ * @param v array of clip space v4 vertices
+ * @param tri array of 3 * ntri vertex indices
+ * @param ntri number of triangles
+ * @param guard guard band width as a multiple of the viewport, below 1 is 1
+ * @param pos array of 3 * max v4 corners out
+ * @param bary array of 3 * max v3 corner weights out
+ * @param src array of max source triangle indices out
+ * @param max capacity of src
+ * @return number of triangles out, may exceed max
+ */
+int clipn(const v4 *v, const int *tri, int ntri, float guard,
+          v4 *pos, v3 *bary, int *src, int max) {
+  unsigned code[3 * CLIPBLOCK], all, any;
+  clipv poly[2][CLIPMAX];
+  float g = guard > 1 ? guard : 1;
+  int f, f0, fn, i, k, n, cur, cnt = 0;
+  for (f0 = 0; f0 < ntri; f0 += CLIPBLOCK) {
+    fn = ntri - f0 < CLIPBLOCK ? ntri - f0 : CLIPBLOCK;
+    i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= 3 * fn; i += 4)
+      clipcode4(v, tri + 3 * f0 + i, g, code + i);
+#endif
+    for (; i < 3 * fn; i++)
+      code[i] = clipcode(v[tri[3 * f0 + i]], g);
+    for (f = 0; f < fn; f++) {
+      all = code[3 * f] & code[3 * f + 1] & code[3 * f + 2];
+      any = code[3 * f] | code[3 * f + 1] | code[3 * f + 2];
+      if (all & 0x3f)
+        continue;
+      for (k = 0; k < 3; k++) {
+        poly[0][k].p = v[tri[3 * (f0 + f) + k]];
+        poly[0][k].b = (v3){k == 0, k == 1, k == 2};
+      }
+      n = 3;
+      cur = 0;
+      /* near and far always, x and y only past the guard band */
+      for (k = 4; k < 10 && n >= 3; k++)
+        if (any >> k & 1) {
+          n = clipplane(poly[cur], n, poly[!cur], g, k);
+          cur = !cur;
+        }
+      for (k = 1; k + 1 < n; k++, cnt++)
+        if (cnt < max) {
+          pos[3 * cnt] = poly[cur][0].p;
+          pos[3 * cnt + 1] = poly[cur][k].p;
+          pos[3 * cnt + 2] = poly[cur][k + 1].p;
+          bary[3 * cnt] = poly[cur][0].b;
+          bary[3 * cnt + 1] = poly[cur][k].b;
+          bary[3 * cnt + 2] = poly[cur][k + 1].b;
+          src[cnt] = f0 + f;
+        }
+    }
+  }
+  return cnt;
+}
+
+/*---- rasterizer functions ----*/
+
+#define ZTILE 32
+
+/**
+ * allocate a depth buffer.
+ * pixels start cleared, arrays are NULL on failure.
+ *
+ * @param w width in pixels
+ * @param h height in pixels
+ * @return zbuf
+ */
+zbuf zbufnew(int w, int h) {
+  zbuf z;
+  z.w = w;
+  z.h = h;
+  z.z = malloc(sizeof(float) * (w * h > 0 ? w * h : 1));
+  z.id = malloc(sizeof(int) * (w * h > 0 ? w * h : 1));
+  z.uv = malloc(sizeof(v2) * (w * h > 0 ? w * h : 1));
+  if (!z.z || !z.id || !z.uv)
+    zbuffree(&z);
+  else
+    zbufclear(&z);
+  return z;
+}
+
+/**
+ * free a depth buffer.
+ *
+ * @param z zbuf
+ * @return void
+ */
+void zbuffree(zbuf *z) {
+  free(z->z);
+  free(z->id);
+  free(z->uv);
+  z->z = NULL;
+  z->id = NULL;
+  z->uv = NULL;
+  z->w = z->h = 0;
+}
+
+/**
+ * clear a depth buffer.
+ * depth to infinity and triangles to -1.
+ *
+ * @param z zbuf
+ * @return void
+ */
+void zbufclear(zbuf *z) {
+  int i;
+  for (i = 0; i < z->w * z->h; i++) {
+    z->z[i] = HUGE_VAL;
+    z->id[i] = -1;
+    z->uv[i] = (v2){0, 0};
+  }
+}
+
+/**
+ * edge functions of screen triangle s.
+ * edge k is opposite corner k, e[3k] x + e[3k + 1] y + e[3k + 2]
+ * relative to corner 0 and positive inside. e[9] is one over
+ * twice the area. 0 for degenerate or unprojected triangles.
+ */
+static int zedge(const v4 *s, float *e) {
+  float a;
+  int k;
+  if (!(s[0].w > 0 && s[1].w > 0 && s[2].w > 0))
+    return 0;
+  e[0] = s[1].y - s[2].y;
+  e[1] = s[2].x - s[1].x;
+  e[2] = e[0] * (s[0].x - s[1].x) + e[1] * (s[0].y - s[1].y);
+  e[3] = s[2].y - s[0].y;
+  e[4] = s[0].x - s[2].x;
+  e[5] = 0;
+  e[6] = s[0].y - s[1].y;
+  e[7] = s[1].x - s[0].x;
+  e[8] = 0;
+  a = e[2];
+  if (!(a > 0 || a < 0))
+    return 0;
+  if (a < 0)
+    for (k = 0; k < 9; k++)
+      e[k] = -e[k];
+  e[9] = 1 / (a < 0 ? -a : a);
+  return 1;
+}
+
+/** pixel rect of s clipped to w by h as x0, y0, x1, y1 inclusive, 0 if empty */
+static int zrect(const v4 *s, int w, int h, int *r) {
+  float lo[2], hi[2], lim[2];
+  int k;
+  lo[0] = hi[0] = s[0].x;
+  lo[1] = hi[1] = s[0].y;
+  for (k = 1; k < 3; k++) {
+    lo[0] = s[k].x < lo[0] ? s[k].x : lo[0];
+    hi[0] = s[k].x > hi[0] ? s[k].x : hi[0];
+    lo[1] = s[k].y < lo[1] ? s[k].y : lo[1];
+    hi[1] = s[k].y > hi[1] ? s[k].y : hi[1];
+  }
+  for (k = 0; k < 2; k++) {
+    lo[k] -= 0.5f;
+    hi[k] -= 0.5f;
+  }
+  lim[0] = w - 1;
+  lim[1] = h - 1;
+  for (k = 0; k < 2; k++) {
+    if (!(lo[k] <= lim[k] && hi[k] >= 0))
+      return 0;
+    lo[k] = lo[k] > 0 ? lo[k] : 0;
+    hi[k] = hi[k] < lim[k] ? hi[k] : lim[k];
+    r[k] = (int)lo[k];
+    r[k] += r[k] < lo[k];
+    r[k + 2] = (int)hi[k];
+    if (r[k] > r[k + 2])
+      return 0;
+  }
+  return 1;
+}
+
+/** 1 if pixel centers x0, y0 to x1, y1 may touch edges e relative to s0 */
+static int ztouch(const float *e, v4 s0, int x0, int y0, int x1, int y1) {
+  float x, y;
+  int k;
+  for (k = 0; k < 3; k++) {
+    x = (e[3 * k] > 0 ? x1 : x0) + 0.5f - s0.x;
+    y = (e[3 * k + 1] > 0 ? y1 : y0) + 0.5f - s0.y;
+    if (e[3 * k] * x + e[3 * k + 1] * y + e[3 * k + 2] < 0)
+      return 0;
+  }
+  return 1;
+}
+
+/**
+ * bin clip space triangles into screen tiles.
+ * corners go through the perspective divide to a w by h
+ * viewport with y down, and each triangle is listed in
+ * the tiles its edges may touch. triangles must be clipped
+ * to the near plane first, those with w <= 0 are dropped.
+ *
+ * @param pos array of 3 * n clip space v4 corners
+ * @param n number of triangles
+ * @param w width in pixels
+ * @param h height in pixels
+ * @return zbin, arrays NULL on allocation failure
+ */
+zbin zbinbuild(const v4 *pos, int n, int w, int h) {
+  zbin b;
+  v4 p;
+  float e[10];
+  int i, t, tx, ty, x0, y0, pass, r[4];
+  b.w = w;
+  b.h = h;
+  b.tw = (w + ZTILE - 1) / ZTILE;
+  b.th = (h + ZTILE - 1) / ZTILE;
+  b.n = n;
+  b.tri = NULL;
+  b.s = malloc(sizeof(v4) * 3 * (n > 0 ? n : 1));
+  b.start = calloc(b.tw * b.th + 1, sizeof(int));
+  if (!b.s || !b.start) {
+    zbinfree(&b);
+    return b;
+  }
+  for (i = 0; i < 3 * n; i++) {
+    p = pos[i];
+    if (p.w > 0) {
+      b.s[i].x = (p.x / p.w * 0.5f + 0.5f) * w;
+      b.s[i].y = (0.5f - p.y / p.w * 0.5f) * h;
+      b.s[i].z = p.z / p.w;
+      b.s[i].w = 1 / p.w;
+    } else {
+      b.s[i] = (v4){0, 0, 0, 0};
+    }
+  }
+  /* count then fill, start[t + 1] is the running end of tile t */
+  for (pass = 0; pass < 2; pass++) {
+    for (i = 0; i < n; i++) {
+      if (!zedge(b.s + 3 * i, e) || !zrect(b.s + 3 * i, w, h, r))
+        continue;
+      for (ty = r[1] / ZTILE; ty <= r[3] / ZTILE; ty++)
+        for (tx = r[0] / ZTILE; tx <= r[2] / ZTILE; tx++) {
+          x0 = tx * ZTILE;
+          y0 = ty * ZTILE;
+          if (!ztouch(e, b.s[3 * i], x0 > r[0] ? x0 : r[0],
+                      y0 > r[1] ? y0 : r[1],
+                      x0 + ZTILE - 1 < r[2] ? x0 + ZTILE - 1 : r[2],
+                      y0 + ZTILE - 1 < r[3] ? y0 + ZTILE - 1 : r[3]))
+            continue;
+          t = ty * b.tw + tx;
+          if (pass)
+            b.tri[b.start[t + 1]++] = i;
+          else
+            b.start[t + 1]++;
+        }
+    }
+    if (!pass) {
+      for (t = 0; t < b.tw * b.th; t++)
+        b.start[t + 1] += b.start[t];
+      b.tri = malloc(sizeof(int) * (b.start[t] > 0 ? b.start[t] : 1));
+      if (!b.tri) {
+        zbinfree(&b);
+        return b;
+      }
+      for (t = b.tw * b.th; t > 0; t--)
+        b.start[t] = b.start[t - 1];
+    }
+  }
+  return b;
+}
+
+/**
+ * free binned triangles.
+ *
+ * @param b zbin
+ * @return void
+ */
+void zbinfree(zbin *b) {
+  free(b->start);
+  free(b->tri);
+  free(b->s);
+  b->start = NULL;
+  b->tri = NULL;
+  b->s = NULL;
+  b->tw = b->th = b->n = 0;
+}
+
+/*
+ * zstep tests up to ZLANE pixels of a row at once: coverage
+ * on the three edges with the top left rule, weights, depth
+ * and the depth test. px is the x of the first pixel center
+ * relative to corner 0, c holds the row edge offsets then
+ * z0, dz1 and dz2, and only the first n pixels are live.
+ * bit k of the result is set where pixel k passes.
+ */
+#if defined(__AVX512F__)
+
+#define ZLANE 16
+
+/** 16 pixels per step in avx-512 */
+static unsigned zstep(const float *e, const int *tl, const float *c, float px,
+                      const float *zp, int n, float *ez, float *eu,
+                      float *ev) {
+  __m512 zero = _mm512_setzero_ps();
+  __m512 x = _mm512_add_ps(_mm512_set1_ps(px),
+                           _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+                                          11, 12, 13, 14, 15));
+  __m512 e0 = _mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(e[0]), x),
+                            _mm512_set1_ps(c[0]));
+  __m512 e1 = _mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(e[3]), x),
+                            _mm512_set1_ps(c[1]));
+  __m512 e2 = _mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(e[6]), x),
+                            _mm512_set1_ps(c[2]));
+  __m512 z = _mm512_add_ps(_mm512_set1_ps(c[3]),
+             _mm512_add_ps(_mm512_mul_ps(e1, _mm512_set1_ps(c[4])),
+                           _mm512_mul_ps(e2, _mm512_set1_ps(c[5]))));
+  __mmask16 m = n < 16 ? (1u << n) - 1 : 0xffff;
+  m &= tl[0] ? _mm512_cmp_ps_mask(e0, zero, _CMP_GE_OQ)
+             : _mm512_cmp_ps_mask(e0, zero, _CMP_GT_OQ);
+  m &= tl[1] ? _mm512_cmp_ps_mask(e1, zero, _CMP_GE_OQ)
+             : _mm512_cmp_ps_mask(e1, zero, _CMP_GT_OQ);
+  m &= tl[2] ? _mm512_cmp_ps_mask(e2, zero, _CMP_GE_OQ)
+             : _mm512_cmp_ps_mask(e2, zero, _CMP_GT_OQ);
+  m &= _mm512_cmp_ps_mask(z, _mm512_maskz_loadu_ps(m, zp), _CMP_LT_OQ);
+  _mm512_storeu_ps(ez, z);
+  _mm512_storeu_ps(eu, _mm512_mul_ps(e1, _mm512_set1_ps(e[9])));
+  _mm512_storeu_ps(ev, _mm512_mul_ps(e2, _mm512_set1_ps(e[9])));
+  return m;
+}
+
+#elif defined(__AVX2__)
+
+#define ZLANE 8
+
+/** edge test of one lane vector, >= 0 on top left edges and > 0 elsewhere */
+static __m256 zedgein(__m256 e, int tl) {
+  __m256 zero = _mm256_setzero_ps();
+  return tl ? _mm256_cmp_ps(e, zero, _CMP_GE_OQ)
+            : _mm256_cmp_ps(e, zero, _CMP_GT_OQ);
+}
+
+/** 8 pixels per step in avx2 */
+static unsigned zstep(const float *e, const int *tl, const float *c, float px,
+                      const float *zp, int n, float *ez, float *eu,
+                      float *ev) {
+  __m256 x = _mm256_add_ps(_mm256_set1_ps(px),
+                           _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+  __m256 e0 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(e[0]), x),
+                            _mm256_set1_ps(c[0]));
+  __m256 e1 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(e[3]), x),
+                            _mm256_set1_ps(c[1]));
+  __m256 e2 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(e[6]), x),
+                            _mm256_set1_ps(c[2]));
+  __m256 z = _mm256_add_ps(_mm256_set1_ps(c[3]),
+             _mm256_add_ps(_mm256_mul_ps(e1, _mm256_set1_ps(c[4])),
+                           _mm256_mul_ps(e2, _mm256_set1_ps(c[5]))));
+  __m256i live = _mm256_cmpgt_epi32(_mm256_set1_epi32(n),
+                                    _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+  __m256 m = _mm256_and_ps(_mm256_and_ps(zedgein(e0, tl[0]),
+                                         zedgein(e1, tl[1])),
+                           zedgein(e2, tl[2]));
+  m = _mm256_and_ps(m, _mm256_cmp_ps(z, _mm256_maskload_ps(zp, live),
+                                     _CMP_LT_OQ));
+  m = _mm256_and_ps(m, _mm256_castsi256_ps(live));
+  _mm256_storeu_ps(ez, z);
+  _mm256_storeu_ps(eu, _mm256_mul_ps(e1, _mm256_set1_ps(e[9])));
+  _mm256_storeu_ps(ev, _mm256_mul_ps(e2, _mm256_set1_ps(e[9])));
+  return _mm256_movemask_ps(m);
+}
+
+#elif defined(__SSE2__)
+
+#define ZLANE 4
+
+/** edge test of one lane vector, >= 0 on top left edges and > 0 elsewhere */
+static __m128 zedgein(__m128 e, int tl) {
+  __m128 zero = _mm_setzero_ps();
+  return tl ? _mm_cmpge_ps(e, zero) : _mm_cmpgt_ps(e, zero);
+}
+
+/** 4 pixels per step in sse2, the x86-64 baseline */
+static unsigned zstep(const float *e, const int *tl, const float *c, float px,
+                      const float *zp, int n, float *ez, float *eu,
+                      float *ev) {
+  float old[4];
+  int k;
+  __m128 x = _mm_add_ps(_mm_set1_ps(px), _mm_setr_ps(0, 1, 2, 3));
+  __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e[0]), x),
+                         _mm_set1_ps(c[0]));
+  __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e[3]), x),
+                         _mm_set1_ps(c[1]));
+  __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e[6]), x),
+                         _mm_set1_ps(c[2]));
+  __m128 z = _mm_add_ps(_mm_set1_ps(c[3]),
+             _mm_add_ps(_mm_mul_ps(e1, _mm_set1_ps(c[4])),
+                        _mm_mul_ps(e2, _mm_set1_ps(c[5]))));
+  __m128 m = _mm_and_ps(_mm_and_ps(zedgein(e0, tl[0]), zedgein(e1, tl[1])),
+                        zedgein(e2, tl[2]));
+  /* the row may end inside the step, so load only live depths */
+  for (k = 0; k < 4; k++)
+    old[k] = k < n ? zp[k] : 0;
+  m = _mm_and_ps(m, _mm_cmplt_ps(z, _mm_loadu_ps(old)));
+  _mm_storeu_ps(ez, z);
+  _mm_storeu_ps(eu, _mm_mul_ps(e1, _mm_set1_ps(e[9])));
+  _mm_storeu_ps(ev, _mm_mul_ps(e2, _mm_set1_ps(e[9])));
+  return _mm_movemask_ps(m) & ((1u << n) - 1);
+}
+
+#else
+
+#define ZLANE 8
+
+/** ZLANE pixels per step in plain c */
+static unsigned zstep(const float *e, const int *tl, const float *c, float px,
+                      const float *zp, int n, float *ez, float *eu,
+                      float *ev) {
+  float e0, e1, e2;
+  unsigned m = 0;
+  int k;
+  for (k = 0; k < n; k++) {
+    e0 = e[0] * (px + k) + c[0];
+    e1 = e[3] * (px + k) + c[1];
+    e2 = e[6] * (px + k) + c[2];
+    eu[k] = e1 * e[9];
+    ev[k] = e2 * e[9];
+    ez[k] = c[3] + e1 * c[4] + e2 * c[5];
+    if ((e0 > 0 || (e0 >= 0 && tl[0])) && (e1 > 0 || (e1 >= 0 && tl[1])) &&
+        (e2 > 0 || (e2 >= 0 && tl[2])) && ez[k] < zp[k])
+      m |= 1u << k;
+  }
+  return m;
+}
+
+#endif
+
+/** rasterize screen triangle s with edges e as id over pixel rect r */
+static void zdraw(zbuf *z, const v4 *s, const float *e, int id,
+                  const int *r) {
+  float ez[ZLANE], eu[ZLANE], ev[ZLANE], c[6], py, iw, *zp;
+  int x, y, k, i, n, tl[3];
+  unsigned m;
+  for (k = 0; k < 3; k++)
+    tl[k] = e[3 * k] > 0 || (e[3 * k] == 0 && e[3 * k + 1] > 0);
+  c[3] = s[0].z;
+  c[4] = (s[1].z - s[0].z) * e[9];
+  c[5] = (s[2].z - s[0].z) * e[9];
+  for (y = r[1]; y <= r[3]; y++) {
+    py = y + 0.5f - s[0].y;
+    c[0] = e[1] * py + e[2];
+    c[1] = e[4] * py + e[5];
+    c[2] = e[7] * py + e[8];
+    zp = z->z + y * z->w;
+    for (x = r[0]; x <= r[2]; x += ZLANE) {
+      n = r[2] - x + 1 < ZLANE ? r[2] - x + 1 : ZLANE;
+      m = zstep(e, tl, c, x + 0.5f - s[0].x, zp + x, n, ez, eu, ev);
+      for (k = 0; m; k++, m >>= 1)
+        if (m & 1) {
+          i = y * z->w + x + k;
+          iw = s[0].w + eu[k] * (s[1].w - s[0].w) + ev[k] * (s[2].w - s[0].w);
+          z->z[i] = ez[k];
+          z->id[i] = id;
+          z->uv[i] = (v2){eu[k] * s[1].w / iw, ev[k] * s[2].w / iw};
+        }
+    }
+  }
+}
+
+/**
+ * rasterize a range of tiles.
+ * tiles t0 to t1 of b are drawn into z with a less than
+ * depth test, triangles within a tile in order. tiles
+ * cover disjoint pixels, so ranges can be drawn in
+ * parallel. uv are perspective correct weights of
+ * corners 1 and 2.
+ *
+ * @param z zbuf the size b was binned for
+ * @param b zbin
+ * @param t0 first tile
+ * @param t1 end tile, at most b->tw * b->th
+ * @return void
+ */
+void zbufraster(zbuf *z, const zbin *b, int t0, int t1) {
+  float e[10];
+  int t, j, f, x0, y0, r[4];
+  for (t = t0; t < t1; t++) {
+    x0 = t % b->tw * ZTILE;
+    y0 = t / b->tw * ZTILE;
+    for (j = b->start[t]; j < b->start[t + 1]; j++) {
+      f = b->tri[j];
+      zedge(b->s + 3 * f, e);
+      zrect(b->s + 3 * f, b->w, b->h, r);
+      r[0] = r[0] > x0 ? r[0] : x0;
+      r[1] = r[1] > y0 ? r[1] : y0;
+      r[2] = r[2] < x0 + ZTILE - 1 ? r[2] : x0 + ZTILE - 1;
+      r[3] = r[3] < y0 + ZTILE - 1 ? r[3] : y0 + ZTILE - 1;
+      zdraw(z, b->s + 3 * f, e, f, r);
+    }
+  }
+}
+
+/**
+ * rasterize clip space triangles into a depth buffer.
+ * bins then draws every tile, see zbinbuild and zbufraster.
+ *
+ * @param z zbuf
+ * @param pos array of 3 * n clip space v4 corners
+ * @param n number of triangles
+ * @return 1, or -1 on allocation failure
+ */
+int zbufdraw(zbuf *z, const v4 *pos, int n) {
+  zbin b = zbinbuild(pos, n, z->w, z->h);
+  if (!b.start)
+    return -1;
+  zbufraster(z, &b, 0, b.tw * b.th);
+  zbinfree(&b);
+  return 1;
+}
+
+/*---- occlusion functions ----*/
+
+/** offset of level l in o->z, its size out in w and h */
+static int occlevel(const occbuf *o, int l, int *w, int *h) {
+  int k, off = 0;
+  for (k = 0; k <= l; k++) {
+    *w = (o->w + (1 << k) - 1) >> k;
+    *h = (o->h + (1 << k) - 1) >> k;
+    if (k < l)
+      off += *w * *h;
+  }
+  return off;
+}
+
+/**
+ * allocate an occlusion buffer.
+ * meant to be low resolution, the pyramid goes down to
+ * 1x1 and starts cleared. z is NULL on failure.
+ *
+ * @param w width in pixels
+ * @param h height in pixels
+ * @return occbuf
+ */
+occbuf occnew(int w, int h) {
+  occbuf o;
+  int lw, lh, n;
+  o.w = w > 0 ? w : 1;
+  o.h = h > 0 ? h : 1;
+  for (o.levels = 1; o.w > 1 << (o.levels - 1) || o.h > 1 << (o.levels - 1);)
+    o.levels++;
+  n = occlevel(&o, o.levels - 1, &lw, &lh) + 1;
+  o.z = malloc(sizeof(float) * n);
+  if (o.z)
+    occclear(&o);
+  else
+    o.w = o.h = o.levels = 0;
+  return o;
+}
+
+/**
+ * free an occlusion buffer.
+ *
+ * @param o occbuf
+ * @return void
+ */
+void occfree(occbuf *o) {
+  free(o->z);
+  o->z = NULL;
+  o->w = o->h = o->levels = 0;
+}
+
+/**
+ * clear an occlusion buffer.
+ * every level to infinity, occluding nothing.
+ *
+ * @param o occbuf
+ * @return void
+ */
+void occclear(occbuf *o) {
+  int i, w, h, n;
+  if (!o->z)
+    return;
+  n = occlevel(o, o->levels - 1, &w, &h) + 1;
+  for (i = 0; i < n; i++)
+    o->z[i] = HUGE_VAL;
+}
+
+/**
+ * rasterize occluder triangles.
+ * vertices go through the view projection m to a viewport
+ * with y down like zbinbuild. coverage is conservative, a
+ * pixel only takes a triangle covering all of it, at the
+ * farthest depth of the triangle over it. triangles past
+ * the near plane are dropped. call occbuild after.
+ *
+ * @param o occbuf
+ * @param v array of v3 vertices
+ * @param tri array of 3 * ntri vertex indices
+ * @param ntri number of triangles
+ * @param m view projection m4
+ * @return void
+ */
+void occdraw(occbuf *o, const v3 *v, const int *tri, int ntri, m4 m) {
+  v4 s[3], p;
+  float e[10], in[3], dz1, dz2, pad, zmax, px, py, e0, e1, e2, d, *zp;
+  int f, k, x, y, ok, r[4];
+  for (f = 0; f < ntri; f++) {
+    ok = 1;
+    for (k = 0; k < 3; k++) {
+      p = m4xv4(m, (v4){v[tri[3 * f + k]].x, v[tri[3 * f + k]].y,
+                        v[tri[3 * f + k]].z, 1});
+      ok &= p.w > 0 && p.z >= 0;
+      s[k].x = (p.x / p.w * 0.5f + 0.5f) * o->w;
+      s[k].y = (0.5f - p.y / p.w * 0.5f) * o->h;
+      s[k].z = p.z / p.w;
+      s[k].w = 1;
+    }
+    if (!ok || !zedge(s, e) || !zrect(s, o->w, o->h, r))
+      continue;
+    dz1 = (s[1].z - s[0].z) * e[9];
+    dz2 = (s[2].z - s[0].z) * e[9];
+    /* farthest the depth plane gets within half a pixel */
+    pad = 0.5f * (fabs(e[3] * dz1 + e[6] * dz2) +
+                  fabs(e[4] * dz1 + e[7] * dz2));
+    zmax = fmaxf(s[0].z, fmaxf(s[1].z, s[2].z));
+    /* edge values with every pixel corner inside */
+    for (k = 0; k < 3; k++)
+      in[k] = 0.5f * (fabs(e[3 * k]) + fabs(e[3 * k + 1]));
+    for (y = r[1]; y <= r[3]; y++) {
+      py = y + 0.5f - s[0].y;
+      zp = o->z + y * o->w;
+      for (x = r[0]; x <= r[2]; x++) {
+        px = x + 0.5f - s[0].x;
+        e0 = e[0] * px + e[1] * py + e[2];
+        e1 = e[3] * px + e[4] * py + e[5];
+        e2 = e[6] * px + e[7] * py + e[8];
+        if (e0 < in[0] || e1 < in[1] || e2 < in[2])
+          continue;
+        d = fminf(s[0].z + e1 * dz1 + e2 * dz2 + pad, zmax);
+        if (d < zp[x])
+          zp[x] = d;
+      }
+    }
+  }
+}
+
+/**
+ * build the occlusion pyramid.
+ * each level keeps the farthest depth of 2x2 below it.
+ *
+ * @param o occbuf
+ * @return void
+ */
+void occbuild(occbuf *o) {
+  float *a, *b;
+  int l, x, y, w, h, nw, nh, x1, y1;
+  for (l = 1; l < o->levels; l++) {
+    a = o->z + occlevel(o, l - 1, &w, &h);
+    b = o->z + occlevel(o, l, &nw, &nh);
+    for (y = 0; y < nh; y++)
+      for (x = 0; x < nw; x++) {
+        x1 = 2 * x + 1 < w ? 2 * x + 1 : 2 * x;
+        y1 = 2 * y + 1 < h ? 2 * y + 1 : 2 * y;
+        b[y * nw + x] = fmaxf(fmaxf(a[2 * y * w + 2 * x], a[2 * y * w + x1]),
+                              fmaxf(a[y1 * w + 2 * x], a[y1 * w + x1]));
+      }
+  }
+}
+
+/**
+ * batched occlusion test of bounding boxes.
+ * each box is projected through m to a screen rect and
+ * nearest depth, then checked against the pyramid level
+ * where the rect spans at most 2x2. boxes off screen or
+ * behind the camera are hidden, boxes crossing the near
+ * plane are visible.
+ *
+ * @param o occbuf after occbuild
+ * @param box array of aabb
+ * @param n number of boxes
+ * @param m view projection m4
+ * @param vis array of n flags out, 1 if the box may be visible
+ * @return number of visible boxes
+ */
+int occtest(const occbuf *o, const aabb *box, int n, m4 m,
+            unsigned char *vis) {
+  v4 p;
+  float lo[2], hi[2], zmin, zfar, *z;
+  int i, k, l, w, h, behind, cnt = 0, r[4];
+  for (i = 0; i < n; i++) {
+    lo[0] = lo[1] = HUGE_VAL;
+    hi[0] = hi[1] = -HUGE_VAL;
+    zmin = HUGE_VAL;
+    behind = 0;
+    for (k = 0; k < 8; k++) {
+      p = m4xv4(m, (v4){k & 1 ? box[i].max.x : box[i].min.x,
+                        k & 2 ? box[i].max.y : box[i].min.y,
+                        k & 4 ? box[i].max.z : box[i].min.z, 1});
+      if (!(p.w > 0 && p.z >= 0)) {
+        behind++;
+        continue;
+      }
+      lo[0] = fminf(lo[0], (p.x / p.w * 0.5f + 0.5f) * o->w);
+      hi[0] = fmaxf(hi[0], (p.x / p.w * 0.5f + 0.5f) * o->w);
+      lo[1] = fminf(lo[1], (0.5f - p.y / p.w * 0.5f) * o->h);
+      hi[1] = fmaxf(hi[1], (0.5f - p.y / p.w * 0.5f) * o->h);
+      zmin = fminf(zmin, p.z / p.w);
+    }
+    if (behind == 8 || (!behind && (hi[0] < 0 || lo[0] >= o->w ||
+                                    hi[1] < 0 || lo[1] >= o->h))) {
+      vis[i] = 0;
+      continue;
+    }
+    if (behind) {
+      vis[i] = 1;
+      cnt++;
+      continue;
+    }
+    r[0] = lo[0] > 0 ? (int)lo[0] : 0;
+    r[1] = lo[1] > 0 ? (int)lo[1] : 0;
+    r[2] = hi[0] < o->w - 1 ? (int)hi[0] : o->w - 1;
+    r[3] = hi[1] < o->h - 1 ? (int)hi[1] : o->h - 1;
+    for (l = 0; l < o->levels - 1 && ((r[2] >> l) - (r[0] >> l) > 1 ||
+                                      (r[3] >> l) - (r[1] >> l) > 1);)
+      l++;
+    z = o->z + occlevel(o, l, &w, &h);
+    zfar = fmaxf(fmaxf(z[(r[1] >> l) * w + (r[0] >> l)],
+                       z[(r[1] >> l) * w + (r[2] >> l)]),
+                 fmaxf(z[(r[3] >> l) * w + (r[0] >> l)],
+                       z[(r[3] >> l) * w + (r[2] >> l)]));
+    vis[i] = !(zmin > zfar);
+    cnt += vis[i];
+  }
+  return cnt;
+}
+
 /* print functions */
 
 /**
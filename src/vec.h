@@ -12,6 +12,7 @@
 #define _VEC_H_
 
 #include <stdlib.h>
+#include <stdint.h>
 
 /**
  * 2d float vector.
@@ -41,6 +42,249 @@ typedef struct m4 {
   float m[4][4];
 } m4;
 
+/**
+ * 3x3 matrix.
+ * used for linear parts such as normal matrices.
+ **/
+typedef struct m3 {
+  float m[3][3];
+} m3;
+
+/**
+ * 3d affine matrix.
+ * an m4 without its projective column, which is
+ * always (0, 0, 0, 1) for rigid, scale and shear transforms.
+ * rows 0-2 hold the linear part and row 3 the translation,
+ * matching the m4 row vector layout.
+ **/
+typedef struct a3 {
+  float m[4][3];
+} a3;
+
+/**
+ * 2d affine matrix.
+ * rows 0-1 hold the linear part and row 2 the translation.
+ **/
+typedef struct a2 {
+  float m[3][2];
+} a2;
+
+/**
+ * decomposed transform.
+ * translation, rotation as a unit quaternion (x, y, z, w)
+ * and per axis scale.
+ **/
+typedef struct trs {
+  v3 t;
+  v4 q;
+  v3 s;
+} trs;
+
+/**
+ * k-d tree over v2 or v3 points.
+ * points are stored flat in tree order, the node for the
+ * range [lo, hi) splits at its middle slot on axis[mid],
+ * so no child pointers are needed.
+ **/
+typedef struct kdtree {
+  int dim, n;
+  float *p;
+  int *idx;
+  unsigned char *axis;
+} kdtree;
+
+/**
+ * uniform spatial hash grid over v2 or v3 points.
+ * points are counting sorted by hashed cell, bucket b
+ * owns slots start[b] up to start[b + 1] of p and idx.
+ **/
+typedef struct hgrid {
+  int dim, n, cap, nbucket;
+  float cell, inv;
+  int *start;
+  int *idx;
+  float *p;
+  unsigned *h;
+} hgrid;
+
+/**
+ * axis aligned bounding box.
+ **/
+typedef struct aabb {
+  v3 min, max;
+} aabb;
+
+/**
+ * v3 array in split form, x[i], y[i], z[i] is element i.
+ * the arrays are only read by functions taking a soa3.
+ **/
+typedef struct soa3 {
+  float *x, *y, *z;
+} soa3;
+
+/**
+ * ray with origin o, direction d and
+ * a maximum hit distance along d.
+ **/
+typedef struct ray {
+  v3 o, d;
+  float tmax;
+} ray;
+
+/**
+ * ray hit.
+ * distance t, barycentrics u and v of the second
+ * and third vertex, and the triangle index or -1.
+ **/
+typedef struct hit {
+  float t, u, v;
+  int tri;
+} hit;
+
+/**
+ * bvh node, 32 bytes.
+ * interior nodes have count 0 and children at left and
+ * left + 1, leaves own count triangles from slot left.
+ **/
+typedef struct bvhnode {
+  float min[3];
+  int left;
+  float max[3];
+  int count;
+} bvhnode;
+
+/**
+ * bounding volume hierarchy over triangles.
+ * tv holds the vertices of each triangle in leaf order
+ * and tri maps leaf slots back to mesh triangles.
+ **/
+typedef struct bvh {
+  int nnode, ntri;
+  bvhnode *node;
+  int *tri;
+  v3 *tv;
+  void *mem;
+} bvh;
+
+/**
+ * dynamic bvh node.
+ * leaves have left -1 and carry a user id, free
+ * nodes have height -1 and chain through parent.
+ **/
+typedef struct dbvhnode {
+  aabb box;
+  int parent, left, right;
+  int id, height;
+} dbvhnode;
+
+/**
+ * dynamic bounding volume hierarchy over aabbs.
+ * leaf handles are node indices and stay valid
+ * until the leaf is removed.
+ **/
+typedef struct dbvh {
+  dbvhnode *node;
+  int cap, count, root, freelist;
+} dbvh;
+
+/**
+ * sweep and prune broad phase.
+ * order holds body indices sorted on the sweep axis
+ * and is kept between updates, buf is sweep scratch.
+ **/
+typedef struct sap {
+  int n, cap, axis;
+  int *order;
+  float *buf;
+} sap;
+
+/**
+ * octree node.
+ * children are the eight nodes from child, or child is -1
+ * for a leaf, which chains its points from head. count and
+ * sum cover every point below the node.
+ **/
+typedef struct octnode {
+  v3 sum;
+  int count;
+  int child, head;
+} octnode;
+
+/**
+ * octree over v3 points.
+ * the root cube is min + [0, size)^3, nodes are pooled in
+ * blocks of eight and next links points within a leaf.
+ **/
+typedef struct octree {
+  v3 min;
+  float size;
+  int depth, bucket;
+  int nnode, ncap, np, pcap;
+  octnode *node;
+  v3 *p;
+  int *next;
+} octree;
+
+/**
+ * dense float matrix of any size.
+ * element (i, j) is a[i * stride + j]. mem owns the
+ * storage and is NULL for views into another matrix.
+ **/
+typedef struct mn {
+  int rows, cols, stride;
+  float *a;
+  void *mem;
+} mn;
+
+/**
+ * compressed sparse row matrix.
+ * row i holds col and val entries start[i] to start[i + 1].
+ **/
+typedef struct csr {
+  int rows, cols, nnz;
+  int *start;
+  int *col;
+  float *val;
+} csr;
+
+/**
+ * depth buffer.
+ * pixel (x, y) is index y * w + x with y down, holding
+ * z / w depth, the triangle drawn there or -1, and its
+ * weights of corners 1 and 2.
+ **/
+typedef struct zbuf {
+  int w, h;
+  float *z;
+  int *id;
+  v2 *uv;
+} zbuf;
+
+/**
+ * triangles binned into screen tiles.
+ * tile t lists triangles tri[start[t]] to tri[start[t + 1]],
+ * tiles run tw across and th down. s holds each corner
+ * as screen x, y, z / w and 1 / w.
+ **/
+typedef struct zbin {
+  int w, h, tw, th, n;
+  int *start;
+  int *tri;
+  v4 *s;
+} zbin;
+
+/**
+ * hierarchical occlusion depth buffer.
+ * level 0 is w by h holding the nearest depth known to be
+ * fully covered, each next level halves the size keeping
+ * the farthest of 2x2, down to 1x1. z holds the levels
+ * in order.
+ **/
+typedef struct occbuf {
+  int w, h, levels;
+  float *z;
+} occbuf;
+
 /* util prototypes */
 float rtod(float rad);
 float dtor(float deg);
@@ -61,6 +305,209 @@ m4 m4xm4(m4 a, m4 b);
 int m4eq(m4 a, m4 b);
 void mprint(m4 m);
 
+/* batched matrix prototypes */
+void m4xm4n(m4 a, const m4 *b, m4 *out, int n);
+void m4nxm4(const m4 *a, m4 b, m4 *out, int n);
+void m4nxm4n(const m4 *a, const m4 *b, m4 *out, int n);
+
+/* affine matrix prototypes */
+a3 a3id();
+a3 m4toa3(m4 m);
+m4 a3tom4(a3 a);
+a3 a3xa3(a3 a, a3 b);
+a3 a3invert(a3 a);
+v3 a3dir(a3 a, v3 v);
+void a3nxa3n(const a3 *a, const a3 *b, a3 *out, int n);
+void a3xv3n(a3 a, const v3 *v, v3 *out, int n);
+void a3dirn(a3 a, const v3 *v, v3 *out, int n);
+
+/* 2d affine matrix prototypes */
+a2 a2id();
+a2 a2trans(float x, float y);
+a2 a2rot(float r);
+a2 a2scl(float x, float y);
+a2 a2xa2(a2 a, a2 b);
+a2 a2invert(a2 a);
+v2 a2dir(a2 a, v2 v);
+void a2xv2n(a2 a, const v2 *v, v2 *out, int n);
+void a2xv2soa(a2 a, const float *x, const float *y,
+              float *ox, float *oy, int n);
+
+/* normal matrix prototypes */
+m3 m4nrm(m4 m);
+m3 a3nrm(a3 a);
+void m3nrmn(m3 m, const v3 *v, v3 *out, int n);
+
+/* transform decomposition prototypes */
+v4 qnlerp(v4 a, v4 b, float t);
+v4 qslerp(v4 a, v4 b, float t);
+trs m4totrs(m4 m);
+m4 trstom4(trs x);
+void m4totrsn(const m4 *m, trs *out, int n);
+void trslerpn(const trs *a, const trs *b, float t, int slerp, m4 *out, int n);
+
+/* k-d tree prototypes */
+kdtree kdbuild2(const v2 *p, int n);
+kdtree kdbuild3(const v3 *p, int n);
+void kdfree(kdtree *t);
+int kdknn2(const kdtree *t, v2 q, int k, int *idx, float *d2);
+int kdknn3(const kdtree *t, v3 q, int k, int *idx, float *d2);
+int kdradius2(const kdtree *t, v2 q, float r, int *idx, int max);
+int kdradius3(const kdtree *t, v3 q, float r, int *idx, int max);
+void kdknnn3(const kdtree *t, const v3 *q, int m, int k, int *idx, float *d2);
+int kdradiusn3(const kdtree *t, const v3 *q, int m, float r,
+               int *idx, int *start, int max);
+
+/* spatial hash grid prototypes */
+hgrid hgnew(int dim, float cell, int ncell);
+void hgfree(hgrid *g);
+int hgbuild2(hgrid *g, const v2 *p, int n);
+int hgbuild3(hgrid *g, const v3 *p, int n);
+int hgradius2(const hgrid *g, v2 q, float r, int *idx, int max);
+int hgradius3(const hgrid *g, v3 q, float r, int *idx, int max);
+int hgpairs(const hgrid *g, float r, int *pairs, int max);
+
+/* pairwise distance prototypes */
+void v3distmat(const v3 *a, int na, const v3 *b, int nb, float *out, int root);
+void v4distmat(const v4 *a, int na, const v4 *b, int nb, float *out, int root);
+int v3within(const v3 *a, int na, const v3 *b, int nb,
+             float r, int *pairs, int max);
+int v4within(const v4 *a, int na, const v4 *b, int nb,
+             float r, int *pairs, int max);
+
+/* bounding volume hierarchy prototypes */
+bvh bvhbuild(const v3 *v, const int *idx, int ntri);
+void bvhfree(bvh *b);
+int bvhhit(const bvh *b, ray r, hit *h);
+int bvhany(const bvh *b, ray r);
+int bvhhitn(const bvh *b, const ray *r, hit *h, int n);
+int bvhanyn(const bvh *b, const ray *r, int *blocked, int n);
+
+/* dynamic bounding volume hierarchy prototypes */
+int aabbxaabb(aabb a, aabb b);
+dbvh dbvhnew();
+void dbvhfree(dbvh *t);
+int dbvhinsert(dbvh *t, aabb box, int id);
+void dbvhremove(dbvh *t, int leaf);
+void dbvhrefit(dbvh *t, const int *leaf, const aabb *box, int n);
+int dbvhquery(const dbvh *t, aabb box, int *ids, int max);
+int dbvhpairs(const dbvh *t, int *pairs, int max);
+
+/* ray intersection kernel prototypes */
+int rayxtrin(ray r, soa3 a, soa3 b, soa3 c, int n,
+             float *t, float *u, float *v, int watertight);
+int raynxtri(soa3 o, soa3 d, const float *tmax, int n, v3 a, v3 b, v3 c,
+             float *t, float *u, float *v, int watertight);
+int rayxaabbn(ray r, soa3 mn, soa3 mx, int n, float *t);
+int rayxsphn(ray r, soa3 c, const float *rad, int n, float *t);
+
+/* sweep and prune prototypes */
+sap sapnew(int axis);
+void sapfree(sap *s);
+int sapupdate(sap *s, const aabb *box, int n, int *pairs, int max);
+int sapupdatesph(sap *s, const v4 *sph, aabb *box, int n,
+                 int *pairs, int max);
+
+/* octree prototypes */
+octree octnew(v3 min, float size, int depth, int bucket);
+void octfree(octree *t);
+int octinsert(octree *t, const v3 *p, int n);
+int octbox(const octree *t, aabb box, float lod, v3 *out, int *w, int max);
+int octfrustum(const octree *t, const v4 *plane, float lod,
+               v3 *out, int *w, int max);
+
+/* morton order prototypes */
+void v2morton(const v2 *p, int n, v2 min, v2 max, unsigned *key);
+void v3morton(const v3 *p, int n, v3 min, v3 max, unsigned *key);
+void v2morton64(const v2 *p, int n, v2 min, v2 max, uint64_t *key);
+void v3morton64(const v3 *p, int n, v3 min, v3 max, uint64_t *key);
+int mortonsort(unsigned *key, int *perm, int n);
+int mortonsort64(uint64_t *key, int *perm, int n);
+void v2gather(const v2 *in, const int *perm, int n, v2 *out);
+void v3gather(const v3 *in, const int *perm, int n, v3 *out);
+void v4gather(const v4 *in, const int *perm, int n, v4 *out);
+
+/* vertex weld prototypes */
+int v3weld(const v3 *v, const v2 *uv, const v4 *attr, int n,
+           float tol, float atol, v3 *out, int *remap, int *uniq);
+
+/* dense matrix prototypes */
+mn mnnew(int rows, int cols);
+void mnfree(mn *m);
+mn mnview(mn m, int r, int c, int rows, int cols);
+void mnid(mn m);
+int mncopy(mn a, mn out);
+int mnadd(mn a, mn b, mn out);
+int mnsub(mn a, mn b, mn out);
+int mnmul(mn a, mn b, mn out);
+int mnscl(mn a, float s, mn out);
+int mntrans(mn a, mn out);
+void mnxv(mn a, const float *x, float *y);
+int mngemm(float alpha, mn a, mn b, float beta, mn c);
+int mnxmn(mn a, mn b, mn out);
+
+/* dense solver prototypes */
+int mnlu(mn a, int *piv);
+int mnlusolve(mn lu, const int *piv, mn b);
+float mnludet(mn lu, const int *piv);
+int mnluinv(mn lu, const int *piv, mn out);
+int mnchol(mn a);
+int mncholsolve(mn l, mn b);
+int mnqr(mn a, float *tau, float *work);
+int mnqrsolve(mn qr, const float *tau, mn b, float *work);
+
+/* sparse matrix prototypes */
+csr csrbuild(int rows, int cols, const int *ri, const int *ci,
+             const float *v, int n);
+void csrfree(csr *a);
+csr csrview(const csr *a, int r0, int r1);
+void csrsplit(const csr *a, int parts, int *first);
+void csrxv(const csr *a, const float *x, float *y);
+void csrxv3(const csr *a, const v3 *x, v3 *y);
+
+/* 3x3 decomposition prototypes */
+void v3cov(const v3 *p, const int *idx, const int *start, int n,
+           v3 *mean, m3 *cov);
+void m3eig(const m3 *a, v3 *val, m3 *vec, int n);
+void m3svd(const m3 *a, m3 *u, v3 *s, m3 *v, int n);
+
+/* rigid registration prototypes */
+int icp(const kdtree *t, const v3 *dst, const v3 *nrm, const v3 *src, int n,
+        m4 *m, int iters, float maxd, float eps, float *err);
+
+/* mesh simplification prototypes */
+int qemsimplify(v3 *v, int *nv, int *tri, int ntri, int target,
+                float maxerr, int *remap);
+
+/* mesh normal prototypes */
+void trinrm(const v3 *v, const int *tri, int ntri, v3 *fn, float *area);
+void vtxnrm(const v3 *v, int nv, const int *tri, int ntri, int angle, v3 *vn);
+csr vtxadj(const int *tri, int ntri, int nv);
+void vtxnrmadj(const v3 *v, const int *tri, const v3 *fn, const float *area,
+               const csr *adj, int angle, v3 *vn);
+
+/* clip space prototypes */
+int clipn(const v4 *v, const int *tri, int ntri, float guard,
+          v4 *pos, v3 *bary, int *src, int max);
+
+/* rasterizer prototypes */
+zbuf zbufnew(int w, int h);
+void zbuffree(zbuf *z);
+void zbufclear(zbuf *z);
+zbin zbinbuild(const v4 *pos, int n, int w, int h);
+void zbinfree(zbin *b);
+void zbufraster(zbuf *z, const zbin *b, int t0, int t1);
+int zbufdraw(zbuf *z, const v4 *pos, int n);
+
+/* occlusion prototypes */
+occbuf occnew(int w, int h);
+void occfree(occbuf *o);
+void occclear(occbuf *o);
+void occdraw(occbuf *o, const v3 *v, const int *tri, int ntri, m4 m);
+void occbuild(occbuf *o);
+int occtest(const occbuf *o, const aabb *box, int n, m4 m,
+            unsigned char *vis);
+
 /* generic prototypes */
 
 /* vadd */
@@ -164,6 +611,11 @@ int v4v4eq(v4 a, v4 b);
 v4 m4xv2(m4 m, v2 v);
 v4 m4xv3(m4 m, v3 v);
 v4 m4xv4(m4 m, v4 v);
+v3 a3xv2(a3 a, v2 v);
+v3 a3xv3(a3 a, v3 v);
+v4 a3xv4(a3 a, v4 v);
+v2 a2xv2(a2 a, v2 v);
+v3 m3xv3(m3 m, v3 v);
 
 
 /* vprint */
@@ -413,16 +865,105 @@ v4 : _Generic ((b), \
 /**
  * matrix vector multiplication.
  * like Ax = b.
+ * an m4 always returns a v4, an a3 returns
+ * a v3 for v2 and v3 points and a v4 for a v4,
+ * an a2 only takes and returns v2,
+ * an m3 only takes and returns v3.
  *
- * @param m an m4
+ * @param m an m4, a3, a2 or m3
  * @param v an N dimensional vector
- * @return a new v4 with the matrix transform applied
+ * @return a new vector with the matrix transform applied
  */
-#define mxv(m, v) _Generic ((v), \
+#define mxv(m, v) _Generic ((m), \
+m4 : _Generic ((v), \
   v2: m4xv2, \
   v3: m4xv3, \
-  v4: m4xv4 \
-)(m, v)
+  v4: m4xv4  \
+),\
+a3 : _Generic ((v), \
+  v2: a3xv2, \
+  v3: a3xv3, \
+  v4: a3xv4  \
+),\
+a2 : a2xv2, \
+m3 : m3xv3) (m, v)
+
+/**
+ * k-d tree build.
+ *
+ * @param p v2 or v3 array
+ * @param n number of points
+ * @return kdtree, release with kdfree
+ */
+#define kdbuild(p, n) _Generic ((p), \
+  v2 *: kdbuild2, \
+  const v2 *: kdbuild2, \
+  v3 *: kdbuild3, \
+  const v3 *: kdbuild3  \
+) (p, n)
+
+/**
+ * k-d tree k nearest neighbours.
+ *
+ * @param t kdtree built from the same dimension as q
+ * @param q v2 or v3 query point
+ * @param k number of neighbours wanted
+ * @param idx int array of k indices out
+ * @param d2 float array of k squared distances out
+ * @return number of neighbours found
+ */
+#define kdknn(t, q, k, idx, d2) _Generic ((q), \
+  v2: kdknn2, \
+  v3: kdknn3  \
+) (t, q, k, idx, d2)
+
+/**
+ * k-d tree radius search.
+ *
+ * @param t kdtree built from the same dimension as q
+ * @param q v2 or v3 query point
+ * @param r search radius
+ * @param idx int array of max indices out
+ * @param max capacity of idx
+ * @return number of points within r
+ */
+#define kdradius(t, q, r, idx, max) _Generic ((q), \
+  v2: kdradius2, \
+  v3: kdradius3  \
+) (t, q, r, idx, max)
+
+/**
+ * spatial hash grid radius search.
+ *
+ * @param g hgrid built from the same dimension as q
+ * @param q v2 or v3 query point
+ * @param r search radius
+ * @param idx int array of max indices out
+ * @param max capacity of idx
+ * @return number of points within r
+ */
+#define hgradius(g, q, r, idx, max) _Generic ((q), \
+  v2: hgradius2, \
+  v3: hgradius3  \
+) (g, q, r, idx, max)
+
+/**
+ * gather a vector array by a permutation.
+ *
+ * @param in v2, v3 or v4 array
+ * @param perm array of n indices into in
+ * @param n number of elements
+ * @param out array of n vectors out, same type as in
+ * @return void
+ */
+#define vgather(in, perm, n, out) _Generic ((in), \
+  v2 *: v2gather, \
+  const v2 *: v2gather, \
+  v3 *: v3gather, \
+  const v3 *: v3gather, \
+  v4 *: v4gather, \
+  const v4 *: v4gather  \
+) (in, perm, n, out)
 
 /**
  * print an vector to terminal.
@@ -1,8 +1,744 @@
 #include "vec.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int fails = 0;
+
+static void check(const char *name, int ok) {
+  if (!ok) {
+    printf("FAIL %s\n", name);
+    fails++;
+  }
+}
+
+static float rnd() { return rand() / (float)RAND_MAX; }
+
+static v3 p3(float x, float y, float z) {
+  v3 v;
+  v.x = x;
+  v.y = y;
+  v.z = z;
+  return v;
+}
+
+static int near(float a, float b) { return fabs(a - b) < 1e-3f; }
+
+static int m4near(m4 a, m4 b) {
+  int i, ok = 1;
+  for (i = 0; i < 16; i++)
+    ok &= near(a.m[i >> 2][i & 3], b.m[i >> 2][i & 3]);
+  return ok;
+}
+
+static void testm4n() {
+  m4 a[3], b[3], out[3];
+  int i, ok = 1;
+  for (i = 0; i < 48; i++) {
+    a[i / 16].m[i / 4 % 4][i % 4] = rnd() - 0.5f;
+    b[i / 16].m[i / 4 % 4][i % 4] = rnd() - 0.5f;
+  }
+  m4xm4n(a[0], b, out, 3);
+  for (i = 0; i < 3; i++)
+    ok &= m4near(out[i], m4xm4(a[0], b[i]));
+  m4nxm4(a, b[0], out, 3);
+  for (i = 0; i < 3; i++)
+    ok &= m4near(out[i], m4xm4(a[i], b[0]));
+  check("m4xm4n and m4nxm4 match m4xm4", ok);
+  /* out may alias an input */
+  out[0] = a[0];
+  out[1] = a[1];
+  out[2] = a[2];
+  m4nxm4n(out, b, out, 3);
+  for (ok = 1, i = 0; i < 3; i++)
+    ok &= m4near(out[i], m4xm4(a[i], b[i]));
+  check("m4nxm4n in place", ok);
+}
+
+static void testa3() {
+  a3 a = a3id(), r;
+  int i, j, ok = 1;
+  a.m[0][1] = 0.4f;
+  a.m[1][1] = 2;
+  a.m[2][0] = -0.3f;
+  a.m[3][0] = 5;
+  a.m[3][2] = -2;
+  r = a3xa3(a, a3invert(a));
+  for (i = 0; i < 4; i++)
+    for (j = 0; j < 3; j++)
+      ok &= near(r.m[i][j], i == j);
+  check("a3invert round trip", ok);
+}
+
+static void testa2() {
+  a2 a = a2xa2(a2xa2(a2scl(2, 0.5f), a2rot(0.7f)), a2trans(3, -1)), r;
+  v2 v[7], w[7];
+  float x[7], y[7];
+  int i, j, ok = 1;
+  r = a2xa2(a, a2invert(a));
+  for (i = 0; i < 3; i++)
+    for (j = 0; j < 2; j++)
+      ok &= near(r.m[i][j], i == j);
+  check("a2invert round trip", ok);
+  for (i = 0; i < 7; i++) {
+    w[i].x = v[i].x = x[i] = rnd() * 4 - 2;
+    w[i].y = v[i].y = y[i] = rnd() * 4 - 2;
+  }
+  a2xv2n(a, v, v, 7);
+  a2xv2soa(a, x, y, x, y, 7);
+  for (ok = 1, i = 0; i < 7; i++) {
+    w[i] = a2xv2(a, w[i]);
+    ok &= near(v[i].x, w[i].x) && near(v[i].y, w[i].y) &&
+          near(x[i], w[i].x) && near(y[i], w[i].y);
+  }
+  check("a2xv2n and a2xv2soa match a2xv2", ok);
+}
+
+static void testnrm() {
+  a3 a = a3id();
+  m3 m;
+  v3 t[2], n[2];
+  int ok = 1;
+  a.m[0][0] = 3;
+  a.m[1][0] = 1;
+  a.m[2][2] = 0.5f;
+  /* a plane through the z axis, tilted by the shear */
+  t[0] = p3(1, 1, 0);
+  t[1] = p3(0, 0, 1);
+  n[0] = n[1] = p3(1, -1, 0);
+  m = a3nrm(a);
+  m3nrmn(m, n, n, 2);
+  t[0] = a3dir(a, t[0]);
+  t[1] = a3dir(a, t[1]);
+  ok &= near(v3v3dot(n[0], t[0]), 0) && near(v3v3dot(n[0], t[1]), 0);
+  ok &= near(v3v3dot(n[0], n[0]), 1) && near(n[0].x, n[1].x);
+  m = m4nrm(a3tom4(a));
+  ok &= near(m3xv3(m, p3(1, -1, 0)).y, m3xv3(a3nrm(a), p3(1, -1, 0)).y);
+  check("normal matrix keeps normals perpendicular", ok);
+}
+
+static void testtrs() {
+  trs a, b, c;
+  m4 m[3];
+  int i, ok = 1;
+  a.t = p3(1, 2, 3);
+  a.q.x = a.q.z = 0;
+  a.q.y = sin(0.4);
+  a.q.w = cos(0.4);
+  a.s = p3(2, 1, 0.5f);
+  b = a;
+  b.t = p3(-1, 0, 5);
+  b.q.y = sin(1.1);
+  b.q.w = cos(1.1);
+  c = m4totrs(trstom4(a));
+  ok &= near(c.t.x, 1) && near(c.t.y, 2) && near(c.t.z, 3);
+  ok &= near(c.s.x, 2) && near(c.s.y, 1) && near(c.s.z, 0.5f);
+  ok &= near(fabs(c.q.y), a.q.y) && near(fabs(c.q.w), a.q.w);
+  check("m4totrs round trip", ok);
+  trslerpn(&a, &b, 0, 1, m, 1);
+  trslerpn(&a, &b, 1, 0, m + 1, 1);
+  m[2] = trstom4(a);
+  for (ok = 1, i = 0; i < 16; i++)
+    ok &= near(m[0].m[i >> 2][i & 3], m[2].m[i >> 2][i & 3]);
+  m[2] = trstom4(b);
+  for (i = 0; i < 16; i++)
+    ok &= near(m[1].m[i >> 2][i & 3], m[2].m[i >> 2][i & 3]);
+  check("trslerpn end points", ok);
+}
+
+/* squared distances from q to p[0..n), sorted ascending */
+static void sortd2(const v3 *p, int n, v3 q, float *d) {
+  float t;
+  int i, j;
+  for (i = 0; i < n; i++) {
+    d[i] = v3v3dot(v3v3sub(p[i], q), v3v3sub(p[i], q));
+    for (j = i; j > 0 && d[j - 1] > d[j]; j--) {
+      t = d[j];
+      d[j] = d[j - 1];
+      d[j - 1] = t;
+    }
+  }
+}
+
+static void testkd() {
+  v3 p[200], q;
+  float d[200], d2[5];
+  int idx[200], i, j, cnt, ok = 1;
+  kdtree t;
+  for (i = 0; i < 200; i++)
+    p[i] = p3(rnd(), rnd(), rnd());
+  t = kdbuild3(p, 200);
+  for (i = 0; i < 10; i++) {
+    q = p3(rnd(), rnd(), rnd());
+    sortd2(p, 200, q, d);
+    ok &= kdknn3(&t, q, 5, idx, d2) == 5;
+    for (j = 0; j < 5; j++)
+      ok &= near(d2[j], d[j]) && near(v3v3dot(v3v3sub(p[idx[j]], q),
+                                          v3v3sub(p[idx[j]], q)), d[j]);
+    for (cnt = 0; cnt < 200 && d[cnt] <= 0.04f; cnt++)
+      ;
+    ok &= kdradius3(&t, q, 0.2f, idx, 200) == cnt;
+  }
+  check("kdtree knn and radius match brute force", ok);
+  kdfree(&t);
+}
+
+static void testhg() {
+  v3 p[300], q;
+  int idx[300], pairs[2 * 300], i, j, cnt, ok = 1;
+  hgrid g = hgnew(3, 0.5f, 64);
+  for (i = 0; i < 300; i++)
+    p[i] = p3(rnd() * 4, rnd() * 4, rnd() * 4);
+  check("hgbuild3", hgbuild3(&g, p, 300) && !hgbuild2(&g, NULL, 0));
+  for (i = 0; i < 10; i++) {
+    q = p3(rnd() * 4, rnd() * 4, rnd() * 4);
+    for (cnt = 0, j = 0; j < 300; j++)
+      cnt += v3v3dot(v3v3sub(p[j], q), v3v3sub(p[j], q)) <= 0.49f;
+    ok &= hgradius3(&g, q, 0.7f, idx, 300) == cnt;
+  }
+  for (cnt = 0, i = 0; i < 300; i++)
+    for (j = i + 1; j < 300; j++)
+      cnt += v3v3dot(v3v3sub(p[i], p[j]), v3v3sub(p[i], p[j])) <= 0.09f;
+  ok &= hgpairs(&g, 0.3f, pairs, 300) == cnt;
+  check("hgradius and hgpairs match brute force", ok);
+  /* huge radii fall back to a linear pass, infinite ones find nothing */
+  ok = hgradius3(&g, p3(2, 2, 2), 1e20f, idx, 300) == 300;
+  ok &= hgradius3(&g, p3(2, 2, 2), HUGE_VAL, idx, 300) == 0;
+  ok &= hgradius3(&g, p3(1e7f, 0, 0), 1e6f, idx, 300) == 0;
+  check("hgradius with huge radii", ok);
+  hgfree(&g);
+}
+
+static void testdist() {
+  v3 a[5], b[70];
+  float d[5 * 70];
+  int pairs[2 * 70 * 70], i, j, cnt = 0, ok = 1;
+  for (i = 0; i < 70; i++)
+    b[i] = p3(rnd(), rnd(), rnd());
+  for (i = 0; i < 5; i++)
+    a[i] = b[i * 13];
+  v3distmat(a, 5, b, 70, d, 1);
+  for (i = 0; i < 5; i++)
+    for (j = 0; j < 70; j++)
+      ok &= near(d[i * 70 + j] * d[i * 70 + j],
+                 v3v3dot(v3v3sub(a[i], b[j]), v3v3sub(a[i], b[j])));
+  check("v3distmat matches direct distances", ok);
+  for (i = 0; i < 70; i++)
+    for (j = i + 1; j < 70; j++)
+      cnt += v3v3dot(v3v3sub(b[i], b[j]), v3v3sub(b[i], b[j])) <= 0.09f;
+  check("v3within self join", v3within(b, 70, b, 70, 0.3f, pairs, 4900) == cnt);
+}
+
+static void testbvh() {
+  v3 v[96];
+  int idx[96], blk[61], i, j, ok = 1;
+  float tx[3][32], ty[3][32], tz[3][32];
+  soa3 c[3];
+  bvh b;
+  ray r, rs[61];
+  hit h, hs[61];
+  for (i = 0; i < 96; i++) {
+    v[i] = p3(rnd() * 8, rnd() * 8, rnd() * 8);
+    idx[i] = i;
+    tx[i % 3][i / 3] = v[i].x;
+    ty[i % 3][i / 3] = v[i].y;
+    tz[i % 3][i / 3] = v[i].z;
+  }
+  for (i = 0; i < 3; i++) {
+    c[i].x = tx[i];
+    c[i].y = ty[i];
+    c[i].z = tz[i];
+  }
+  b = bvhbuild(v, idx, 32);
+  for (i = 0; i < 64; i++) {
+    r.o = p3(rnd() * 8, rnd() * 8, -1);
+    r.d = p3(rnd() - 0.5f, rnd() - 0.5f, 1);
+    r.tmax = HUGE_VAL;
+    j = rayxtrin(r, c[0], c[1], c[2], 32, NULL, NULL, NULL, 0);
+    ok &= bvhhit(&b, r, &h) == (j >= 0) && h.tri == j;
+  }
+  check("bvhhit matches brute force", ok);
+  /* 61 rays leave a short last packet */
+  for (i = 0; i < 61; i++) {
+    rs[i].o = p3(rnd() * 8, rnd() * 8, -1);
+    rs[i].d = p3(rnd() - 0.5f, rnd() - 0.5f, 1);
+    rs[i].tmax = i % 5 ? HUGE_VAL : 4;
+  }
+  j = bvhhitn(&b, rs, hs, 61);
+  check("bvhanyn count", bvhanyn(&b, rs, blk, 61) == j);
+  for (ok = 1, i = 0; i < 61; i++) {
+    j -= bvhhit(&b, rs[i], &h);
+    ok &= hs[i].tri == h.tri && hs[i].t == h.t && blk[i] == (h.tri >= 0);
+  }
+  check("bvhhitn matches bvhhit", ok && j == 0);
+  bvhfree(&b);
+}
+
+static void testdbvh() {
+  aabb box[200], q = {{2, 2, 2}, {6, 6, 6}};
+  int ids[200], leaf[200], i, cnt = 0;
+  dbvh d = dbvhnew();
+  for (i = 0; i < 200; i++) {
+    box[i].min = p3(rnd() * 8, rnd() * 8, rnd() * 8);
+    box[i].max = v3v3add(box[i].min, p3(rnd(), rnd(), rnd()));
+    leaf[i] = dbvhinsert(&d, box[i], i);
+  }
+  for (i = 0; i < 200; i += 2)
+    dbvhremove(&d, leaf[i]);
+  for (i = 1; i < 200; i += 2)
+    cnt += aabbxaabb(q, box[i]);
+  check("dbvhquery matches brute force", dbvhquery(&d, q, ids, 200) == cnt);
+  dbvhfree(&d);
+}
+
+/** results of one rayxtrin step against a single triangle call */
+static int raysame(float t, float u, float v, float t1, float u1, float v1) {
+  return t1 == HUGE_VAL ? t == HUGE_VAL && u == 0 && v == 0
+                        : near(t, t1) && near(u, u1) && near(v, v1);
+}
+
+static void testray() {
+  float ax[37], ay[37], az[37], bx[37], by[37], bz[37], cx[37], cy[37], cz[37];
+  float t[37], u[37], v[37], t1, u1, v1, tmax[37];
+  soa3 a = {ax, ay, az}, b = {bx, by, bz}, c = {cx, cy, cz};
+  int i, j, hits = 0, ok = 1;
+  ray r;
+  /* 37 leaves a tail after whole steps of 4 or 8 */
+  for (i = 0; i < 37; i++) {
+    ax[i] = rnd() * 4; ay[i] = rnd() * 4; az[i] = rnd() * 4;
+    bx[i] = rnd() * 4; by[i] = rnd() * 4; bz[i] = rnd() * 4;
+    cx[i] = rnd() * 4; cy[i] = rnd() * 4; cz[i] = rnd() * 4;
+  }
+  r.o = p3(2, 2, -1);
+  r.d = p3(0.1f, -0.2f, 1);
+  r.tmax = HUGE_VAL;
+  j = rayxtrin(r, a, b, c, 37, t, u, v, 0);
+  for (i = 0; i < 37; i++) {
+    rayxtrin(r, (soa3){ax + i, ay + i, az + i}, (soa3){bx + i, by + i, bz + i},
+             (soa3){cx + i, cy + i, cz + i}, 1, &t1, &u1, &v1, 0);
+    ok &= raysame(t[i], u[i], v[i], t1, u1, v1) && t[i] >= t[j];
+    hits += t1 != HUGE_VAL;
+  }
+  check("rayxtrin matches single triangles", ok && hits > 0 && j >= 0);
+  /* rays along z through a tilted triangle, some cut short */
+  for (i = 0; i < 37; i++) {
+    ax[i] = rnd() * 4; ay[i] = rnd() * 4; az[i] = -1;
+    bx[i] = rnd() * 0.2f - 0.1f; by[i] = rnd() * 0.2f - 0.1f; bz[i] = 1;
+    tmax[i] = i % 3 ? HUGE_VAL : 2;
+  }
+  cx[0] = 0; cy[0] = 0; cz[0] = 1;
+  cx[1] = 4; cy[1] = 0; cz[1] = 2;
+  cx[2] = 0; cy[2] = 4; cz[2] = 3;
+  j = raynxtri(a, b, tmax, 37, p3(0, 0, 1), p3(4, 0, 2), p3(0, 4, 3), t, u, v,
+               0);
+  for (ok = 1, hits = 0, i = 0; i < 37; i++) {
+    r.o = p3(ax[i], ay[i], az[i]);
+    r.d = p3(bx[i], by[i], bz[i]);
+    r.tmax = tmax[i];
+    rayxtrin(r, (soa3){cx, cy, cz}, (soa3){cx + 1, cy + 1, cz + 1},
+             (soa3){cx + 2, cy + 2, cz + 2}, 1, &t1, &u1, &v1, 0);
+    ok &= raysame(t[i], u[i], v[i], t1, u1, v1);
+    hits += t1 != HUGE_VAL;
+  }
+  check("raynxtri matches single rays", ok && hits == j && hits > 0);
+}
+
+static void testsap() {
+  aabb box[120];
+  int pairs[2 * 800], i, j, n, cnt, pass, ok = 1;
+  sap s = sapnew(0);
+  for (i = 0; i < 120; i++) {
+    box[i].min = p3(rnd() * 8, rnd() * 8, rnd() * 8);
+    box[i].max = v3v3add(box[i].min, p3(rnd(), rnd(), rnd()));
+  }
+  /* grow, move everything, then shrink, against brute force */
+  for (pass = 0; pass < 3; pass++) {
+    n = pass == 1 ? 120 : 90;
+    if (pass == 1)
+      for (i = 0; i < n; i++) {
+        box[i].min.x += rnd() - 0.5f;
+        box[i].max.x = box[i].min.x + rnd();
+      }
+    for (cnt = 0, i = 0; i < n; i++)
+      for (j = i + 1; j < n; j++)
+        cnt += aabbxaabb(box[i], box[j]);
+    ok &= sapupdate(&s, box, n, pairs, 800) == cnt && cnt <= 800;
+    for (i = 0; i < cnt; i++)
+      ok &= pairs[2 * i] != pairs[2 * i + 1] && pairs[2 * i] < n &&
+            pairs[2 * i + 1] < n &&
+            aabbxaabb(box[pairs[2 * i]], box[pairs[2 * i + 1]]);
+  }
+  check("sapupdate matches brute force", ok);
+  sapfree(&s);
+}
+
+static void testoct() {
+  v3 p[300], out[300];
+  aabb q = {{2, 2, 2}, {6, 6, 6}};
+  int i, cnt = 0;
+  octree t = octnew(p3(0, 0, 0), 8, 6, 4);
+  for (i = 0; i < 300; i++) {
+    p[i] = p3(rnd() * 8, rnd() * 8, rnd() * 8);
+    cnt += p[i].x >= 2 && p[i].x <= 6 && p[i].y >= 2 && p[i].y <= 6 &&
+           p[i].z >= 2 && p[i].z <= 6;
+  }
+  octinsert(&t, p, 300);
+  check("octbox matches brute force", octbox(&t, q, 0, out, NULL, 300) == cnt);
+  octfree(&t);
+}
+
+static void testmort() {
+  v3 p[2] = {{0, 0, 0}, {1, 0, 0}};
+  unsigned key[300], orig[300];
+  int perm[300], i, ok = 1;
+  v3morton(p, 2, p3(0, 0, 0), p3(1, 1, 1), key);
+  check("v3morton bit order", key[0] == 0 && key[1] == 0x09249249);
+  /* few distinct keys, so stability is visible */
+  for (i = 0; i < 300; i++)
+    key[i] = orig[i] = (unsigned)(rand() % 7) << (i % 2 ? 3 : 19);
+  check("mortonsort", mortonsort(key, perm, 300));
+  for (i = 0; i < 300; i++) {
+    ok &= key[i] == orig[perm[i]];
+    if (i)
+      ok &= key[i - 1] < key[i] ||
+            (key[i - 1] == key[i] && perm[i - 1] < perm[i]);
+  }
+  check("mortonsort order and stability", ok);
+}
+
+static void testweld() {
+  v3 v[256], out[81];
+  int remap[256], uniq[81], i;
+  /* 8x8 grid of quads, each with its own four corners */
+  for (i = 0; i < 256; i++)
+    v[i] = p3(i / 4 % 8 + (i % 4 == 1 || i % 4 == 2), i / 32 + (i % 4 >= 2),
+              0);
+  check("v3weld", v3weld(v, NULL, NULL, 256, 0, 0, out, remap, uniq) == 81);
+}
+
+static void testgemm() {
+  /* crosses the depth, column and row block edges */
+  mn a = mnnew(70, 300), b = mnnew(300, 75), c = mnnew(70, 75);
+  int i, j, k, ok = 1;
+  float d;
+  for (i = 0; i < 70; i++)
+    for (k = 0; k < 300; k++)
+      a.a[i * a.stride + k] = rnd() - 0.5f;
+  for (k = 0; k < 300; k++)
+    for (j = 0; j < 75; j++)
+      b.a[k * b.stride + j] = rnd() - 0.5f;
+  for (i = 0; i < 70; i++)
+    for (j = 0; j < 75; j++)
+      c.a[i * c.stride + j] = i - j;
+  check("mngemm shapes", mngemm(2, a, b, 0.5f, c) && !mngemm(1, b, b, 0, c));
+  for (i = 0; i < 70; i++)
+    for (j = 0; j < 75; j++) {
+      for (d = 0, k = 0; k < 300; k++)
+        d += a.a[i * a.stride + k] * b.a[k * b.stride + j];
+      ok &= near(c.a[i * c.stride + j], 2 * d + 0.5f * (i - j));
+    }
+  check("mngemm matches the naive product", ok);
+  mnfree(&a);
+  mnfree(&b);
+  mnfree(&c);
+}
+
+static void testlu() {
+  int n = 7, piv[7], i, j, ok = 1;
+  mn a = mnnew(n, n), lu = mnnew(n, n), inv = mnnew(n, n);
+  mn p = mnnew(n, n), x = mnnew(n, 1), b = mnnew(n, 1);
+  for (i = 0; i < n * n; i++)
+    a.a[i / n * a.stride + i % n] = rnd() - 0.5f;
+  mncopy(a, lu);
+  check("mnlu", mnlu(lu, piv) && mnluinv(lu, piv, inv));
+  mnxmn(a, inv, p);
+  for (i = 0; i < n; i++)
+    for (j = 0; j < n; j++)
+      ok &= near(p.a[i * p.stride + j], i == j);
+  check("mnluinv round trip", ok);
+  /* a a^T + n i is positive definite */
+  mntrans(a, inv);
+  mnxmn(a, inv, lu);
+  for (i = 0; i < n; i++) {
+    lu.a[i * lu.stride + i] += n;
+    x.a[i * x.stride] = i - 3;
+  }
+  mnxmn(lu, x, b);
+  check("mnchol", mnchol(lu) && mncholsolve(lu, b));
+  for (ok = 1, i = 0; i < n; i++)
+    ok &= near(b.a[i * b.stride], x.a[i * x.stride]);
+  check("mnchol round trip", ok);
+  mnfree(&a);
+  mnfree(&lu);
+  mnfree(&inv);
+  mnfree(&p);
+  mnfree(&x);
+  mnfree(&b);
+}
+
+static void testcsr() {
+  float d[23][17] = {{0}}, v[200], x[17], y[23], yv[23], e;
+  v3 x3[17], y3[23];
+  int ri[200], ci[200], first[4], i, j, p, ok = 1;
+  csr a, w;
+  /* duplicates are summed and triplets outside are dropped */
+  for (i = 0; i < 200; i++) {
+    ri[i] = rand() % 25 - 1;
+    ci[i] = rand() % 18;
+    v[i] = rnd() - 0.5f;
+    if (ri[i] >= 0 && ri[i] < 23 && ci[i] < 17)
+      d[ri[i]][ci[i]] += v[i];
+  }
+  for (j = 0; j < 17; j++) {
+    x[j] = rnd() - 0.5f;
+    x3[j] = p3(x[j], 1, -2 * x[j]);
+  }
+  a = csrbuild(23, 17, ri, ci, v, 200);
+  csrxv(&a, x, y);
+  csrxv3(&a, x3, y3);
+  csrsplit(&a, 3, first);
+  for (p = 0; p < 3; p++) {
+    w = csrview(&a, first[p], first[p + 1]);
+    csrxv(&w, x, yv + first[p]);
+  }
+  for (i = 0; i < 23; i++) {
+    for (e = 0, j = 0; j < 17; j++)
+      e += d[i][j] * x[j];
+    ok &= near(y[i], e) && near(yv[i], e) && near(y3[i].x, e) &&
+          near(y3[i].z, -2 * e);
+  }
+  check("csrxv matches the dense product", ok && first[3] == 23);
+  csrfree(&a);
+}
+
+static void testeig() {
+  m3 a[13], vec[13], u[13], v[13];
+  v3 val[13], sv[13];
+  int n, i, j, k, ok = 1;
+  float e, f, *l, *g;
+  /* 13 matrices fill one block of 8 and part of the next */
+  for (n = 0; n < 13; n++)
+    for (i = 0; i < 3; i++)
+      for (j = 0; j <= i; j++)
+        a[n].m[i][j] = a[n].m[j][i] = rnd() * 2 - 1;
+  m3eig(a, val, vec, 13);
+  m3svd(a, u, sv, v, 13);
+  for (n = 0; n < 13; n++) {
+    l = &val[n].x;
+    g = &sv[n].x;
+    ok &= l[0] <= l[1] && l[1] <= l[2];
+    ok &= g[0] >= g[1] && g[1] >= g[2] && g[2] >= 0;
+    for (i = 0; i < 3; i++)
+      for (j = 0; j < 3; j++) {
+        for (e = f = 0, k = 0; k < 3; k++) {
+          e += l[k] * vec[n].m[k][i] * vec[n].m[k][j];
+          f += g[k] * u[n].m[k][i] * v[n].m[k][j];
+        }
+        ok &= near(e, a[n].m[i][j]) && near(f, a[n].m[i][j]);
+        for (e = f = 0, k = 0; k < 3; k++) {
+          e += vec[n].m[i][k] * vec[n].m[j][k];
+          f += u[n].m[i][k] * u[n].m[j][k];
+        }
+        ok &= near(e, i == j) && near(f, i == j);
+      }
+  }
+  check("m3eig and m3svd reconstruct", ok);
+}
+
+static void testicp() {
+  v3 dst[300], src[300];
+  m4 want = m4xm4(m4zrot(0.1f), m4xrot(0.05f)), inv, m = m4id();
+  v4 w;
+  float err = 1;
+  int i, j, it;
+  kdtree t;
+  /* row vector convention, the translation is the last row */
+  want.m[3][0] = 0.05f;
+  want.m[3][1] = -0.03f;
+  want.m[3][2] = 0.02f;
+  want.m[3][3] = 1;
+  /* src = (dst - t) r^T */
+  inv = want;
+  for (i = 0; i < 3; i++) {
+    inv.m[3][i] = 0;
+    for (j = 0; j < 3; j++) {
+      inv.m[i][j] = want.m[j][i];
+      inv.m[3][i] -= want.m[3][j] * want.m[i][j];
+    }
+  }
+  for (i = 0; i < 300; i++) {
+    dst[i] = p3(rnd(), rnd() * 0.6f, rnd() * 0.3f);
+    w = m4xv3(inv, dst[i]);
+    src[i] = p3(w.x, w.y, w.z);
+  }
+  t = kdbuild3(dst, 300);
+  it = icp(&t, dst, NULL, src, 300, &m, 50, 0, 1e-6f, &err);
+  check("icp recovers a known transform", it > 0 && m4near(m, want) &&
+                                              err < 1e-3f);
+  kdfree(&t);
+}
+
+static void testqem() {
+  v3 v[81];
+  int tri[384], i, q, nv = 81;
+  /* 8x8 grid of quads over 9x9 shared vertices */
+  for (i = 0; i < 81; i++)
+    v[i] = p3(i % 9, i / 9, 0);
+  for (i = 0; i < 64; i++) {
+    q = i / 8 * 9 + i % 8;
+    tri[6 * i] = q;
+    tri[6 * i + 1] = q + 1;
+    tri[6 * i + 2] = q + 10;
+    tri[6 * i + 3] = q;
+    tri[6 * i + 4] = q + 10;
+    tri[6 * i + 5] = q + 9;
+  }
+  i = qemsimplify(v, &nv, tri, 128, 32, 0, NULL);
+  check("qemsimplify", i > 0 && i <= 32 && nv < 81);
+  for (q = 0; q < 3 * i; q++)
+    check("qemsimplify index", tri[q] >= 0 && tri[q] < nv);
+}
+
+static void testvnrm() {
+  v3 v[82], fn[127], vn[82], va[82], e1, e2;
+  float area[127];
+  int tri[381], first[4], i, q, p, angle, ok = 1;
+  csr adj, w;
+  /* a bumpy 9x9 grid, 127 faces leave a tail after steps of 4 */
+  for (i = 0; i < 81; i++)
+    v[i] = p3(i % 9, i / 9, 0.3f * sin(i % 9) * cos(i / 9 * 0.7f));
+  v[81] = p3(0, 0, 5);
+  for (i = 0; i < 127; i++) {
+    q = i / 2 / 8 * 9 + i / 2 % 8;
+    tri[3 * i] = q;
+    tri[3 * i + 1] = i % 2 ? q + 10 : q + 1;
+    tri[3 * i + 2] = i % 2 ? q + 9 : q + 10;
+  }
+  trinrm(v, tri, 127, fn, area);
+  for (i = 0; i < 127; i++) {
+    e1 = v3v3sub(v[tri[3 * i + 1]], v[tri[3 * i]]);
+    e2 = v3v3sub(v[tri[3 * i + 2]], v[tri[3 * i]]);
+    ok &= near(v3v3dot(fn[i], fn[i]), 1) && near(v3v3dot(fn[i], e1), 0) &&
+          near(v3v3dot(fn[i], e2), 0) && fn[i].z > 0;
+    ok &= near(2 * area[i], v3mag((v3){e1.y * e2.z - e1.z * e2.y,
+                                       e1.z * e2.x - e1.x * e2.z,
+                                       e1.x * e2.y - e1.y * e2.x}));
+  }
+  check("trinrm", ok);
+  adj = vtxadj(tri, 127, 82);
+  check("vtxadj", adj.start && !adj.val && adj.start[82] == 381);
+  csrsplit(&adj, 3, first);
+  for (angle = 0; angle < 2; angle++) {
+    vtxnrm(v, 82, tri, 127, angle, vn);
+    for (p = 0; p < 3; p++) {
+      w = csrview(&adj, first[p], first[p + 1]);
+      vtxnrmadj(v, tri, fn, area, &w, angle, va + first[p]);
+    }
+    for (ok = 1, i = 0; i < 81; i++)
+      ok &= near(v3v3dot(vn[i], vn[i]), 1) && near(vn[i].x, va[i].x) &&
+            near(vn[i].y, va[i].y) && near(vn[i].z, va[i].z);
+    ok &= vn[81].x == 0 && vn[81].y == 0 && vn[81].z == 0 && va[81].z == 0;
+    check(angle ? "vtxnrmadj angle weights" : "vtxnrmadj area weights", ok);
+  }
+  csrfree(&adj);
+}
+
+static void testclip() {
+  /* inside, one and two corners behind near, outside x, inside the
+     guard band, past the guard band */
+  v4 v[18] = {{0, 0, 0.5f, 1}, {0.5f, 0, 0.5f, 1}, {0, 0.5f, 0.5f, 1},
+              {0, 0, -0.5f, 1}, {0.5f, 0, 0.5f, 1}, {0, 0.5f, 0.5f, 1},
+              {0, 0, -0.5f, 1}, {0.5f, 0, -0.5f, 1}, {0, 0.5f, 0.5f, 1},
+              {2, 0, 0.5f, 1}, {3, 0, 0.5f, 1}, {2, 1, 0.5f, 1},
+              {0.5f, 0, 0.5f, 1}, {1.5f, 0, 0.5f, 1}, {0.5f, 0.5f, 0.5f, 1},
+              {0, 0, 0.5f, 1}, {5, 0, 0.5f, 1}, {0, 0.5f, 0.5f, 1}};
+  int want[6] = {3, 4, 2, 0, 2, 4}, got[6] = {0}, tri[39], src[20];
+  int i, k, n, ok = 1;
+  v4 pos[60], q;
+  v3 bary[60], b;
+  const int *t;
+  /* 13 triangles, so the 39 corners leave a tail after steps of 4 */
+  for (i = 0; i < 39; i++)
+    tri[i] = i / 3 % 6 * 3 + i % 3;
+  n = clipn(v, tri, 13, 2, pos, bary, src, 20);
+  check("clipn count", n == 15);
+  for (i = 0; i < n && i < 20; i++) {
+    got[src[i] % 6]++;
+    t = tri + 3 * src[i];
+    for (k = 3 * i; k < 3 * i + 3; k++) {
+      b = bary[k];
+      q = v4v4add(v4v4add(v4scl(v[t[0]], b.x), v4scl(v[t[1]], b.y)),
+                  v4scl(v[t[2]], b.z));
+      ok &= near(b.x + b.y + b.z, 1) && b.x > -1e-6f && b.y > -1e-6f &&
+            b.z > -1e-6f;
+      ok &= near(q.x, pos[k].x) && near(q.y, pos[k].y) &&
+            near(q.z, pos[k].z) && near(q.w, pos[k].w);
+      ok &= pos[k].z > -1e-6f && pos[k].x < 2 * pos[k].w + 1e-6f;
+    }
+  }
+  for (i = 0; i < 6; i++)
+    ok &= got[i] == want[i];
+  check("clipn splits and weights", ok);
+}
+
+static void testzbuf() {
+  v4 quad[6] = {{-1, -1, 0.5f, 1}, {1, -1, 0.5f, 1}, {1, 1, 0.5f, 1},
+                {-1, -1, 0.5f, 1}, {1, 1, 0.5f, 1}, {-1, 1, 0.5f, 1}};
+  int i, ok = 1;
+  zbuf z = zbufnew(37, 23);
+  /* two triangles over the viewport cover every pixel once */
+  zbufdraw(&z, quad, 2);
+  for (i = 0; i < 37 * 23; i++)
+    ok &= z.id[i] >= 0 && near(z.z[i], 0.5f);
+  check("zbufdraw covers the viewport", ok);
+  zbuffree(&z);
+}
+
+static void testocc() {
+  v3 wall[3] = {{-100, -50, 10}, {100, -50, 10}, {0, 100, 10}};
+  int tri[3] = {0, 1, 2};
+  aabb box[3] = {{{-1, -1, 20}, {1, 1, 22}},
+                 {{-1, -1, 4}, {1, 1, 6}},
+                 {{200, -1, 4}, {202, 1, 6}}};
+  unsigned char vis[3];
+  occbuf o = occnew(64, 32);
+  m4 m = m4proj(64, 32, 90, 0.1f, 100);
+  occdraw(&o, wall, tri, 1, m);
+  occbuild(&o);
+  occtest(&o, box, 3, m, vis);
+  check("occtest", !vis[0] && vis[1] && !vis[2]);
+  occfree(&o);
+}
+
 int main() {
   v2 a = {1.0, 2.0};
   v2 b = {3.0, 4.0};
   v2 c = vadd(a, b);
   vprint(c);
-  return 0;
+  testm4n();
+  testa3();
+  testa2();
+  testnrm();
+  testtrs();
+  testkd();
+  testhg();
+  testdist();
+  testbvh();
+  testdbvh();
+  testray();
+  testsap();
+  testoct();
+  testmort();
+  testweld();
+  testgemm();
+  testlu();
+  testcsr();
+  testeig();
+  testicp();
+  testqem();
+  testvnrm();
+  testclip();
+  testzbuf();
+  testocc();
+  return fails != 0;
 }